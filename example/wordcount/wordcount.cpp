@@ -14,24 +14,12 @@ namespace ch {
     }
 
     void reducer(SortedStream<Tuple<String, Integer> > & ss, StreamManager<Tuple<String, Integer> > & sm) {
-        bool started = false;
+        GroupIterator<Tuple<String, Integer> > groups{ss};
         Tuple<String, Integer> res;
-        Tuple<String, Integer> e;
-        while (ss.get(e)) {
-            if (started == false) {
-                res = e;
-                started = true;
-            } else {
-                if (res == e) {
-                    res += e;
-                } else {
-                    DSS("Emit: " << res.toString());
-                    sm.push(res);
-                    res = e;
-                }
+        while (groups.nextKey(res)) {
+            for (const Tuple<String, Integer> & e: groups.values()) {
+                res += e;
             }
-        }
-        if (started) {
             DSS("Emit: " << res.toString());
             sm.push(res);
         }
@@ -40,5 +28,8 @@ namespace ch {
 }
 
 extern "C" bool doJob(ch::context_t & context) {
-    return ch::simpleJob<ch::Tuple<ch::String, ch::Integer> >(context);
+    ch::options_t options;
+    options.shuffleCodec = CODEC_LZ;
+    options.spillCodec = CODEC_LZ;
+    return ch::simpleJob<ch::Tuple<ch::String, ch::Integer> >(context, options);
 }
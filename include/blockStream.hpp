@@ -0,0 +1,512 @@
+/*
+ * Block streams: read/write records in (optionally compressed) blocks of a run in a segment store
+ */
+
+#ifndef BLOCKSTREAM_H
+#define BLOCKSTREAM_H
+
+#include <string.h>           // memcpy
+#include <stdint.h>           // uint64_t
+
+#include <string>             // string
+#include <vector>             // vector
+#include <memory>             // shared_ptr
+#include <future>             // future
+
+#include "def.hpp"            // RECORD_BLOCK_SIZE, MAX_RECORD_BLOCK_SIZE, RUN_IO_BUFFER_SIZE,
+                              // CODEC_NONE, SEGMENT_READ_ERROR
+#include "segmentStore.hpp"   // SegmentStore
+#include "compressor.hpp"     // blockHeader_t, encodeBlock, decodeBlock
+#include "metrics.hpp"        // codecMetrics_t
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    template <typename DataType>
+    class BlockWriter {
+
+        protected:
+
+            // The store it writes
+            std::shared_ptr<SegmentStore> _store;
+
+            // The run it writes
+            size_t _run;
+
+            // Codec of blocks
+            uint32_t _codec;
+
+            // Compression metrics
+            codecMetrics_t * _metrics;
+
+            // Serialized records not written yet
+            std::string _block;
+
+            // Number of records in the block
+            uint32_t _count;
+
+            // Sort prefix of the first record in the block
+            uint64_t _firstKey;
+
+            // Encoded blocks not appended yet, appended RUN_IO_BUFFER_SIZE bytes at once
+            std::string _encoded;
+
+            // Encode buffered records as a block
+            bool flushBlock();
+
+            // Append encoded blocks to the run
+            bool flushEncoded();
+
+        public:
+
+            // Constructor
+            explicit BlockWriter(uint32_t codec = CODEC_NONE, codecMetrics_t * metrics = nullptr);
+
+            // Copy constructor (deleted)
+            BlockWriter(const BlockWriter<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            BlockWriter<DataType> & operator = (const BlockWriter<DataType> &) = delete;
+
+            // Destructor
+            ~BlockWriter();
+
+            // Open a run (created empty) of store
+            bool open(const std::shared_ptr<SegmentStore> & store, size_t run);
+
+            // True if a run is opened
+            bool isValid() const;
+
+            // Write a record
+            bool write(const DataType & v);
+
+            // Write a serialized record with its sort prefix
+            bool writePacked(const char * data, size_t length, uint64_t prefix);
+
+            // Flush and close the run
+            bool close();
+    };
+
+    template <typename DataType>
+    class BlockReader {
+
+        protected:
+
+            // The store it reads
+            std::shared_ptr<SegmentStore> _store;
+
+            // The run it reads
+            size_t _run;
+
+            // Offset of _buffer end in the run
+            uint64_t _offset;
+
+            // Compression metrics
+            codecMetrics_t * _metrics;
+
+            // Payload of current block
+            std::string _payload;
+
+            // Serialized records of current block
+            std::string _raw;
+
+            // Cursor in _raw
+            const char * _cursor;
+
+            // Number of records remain in current block
+            uint32_t _remain;
+
+            // Bytes of the run read, RUN_IO_BUFFER_SIZE bytes at once
+            std::vector<char> _buffer;
+
+            // Unconsumed bytes in _buffer: [_begin, _end)
+            size_t _begin;
+            size_t _end;
+
+            // Next bytes of the run, read by an I/O thread of the store while _buffer is consumed
+            std::vector<char> _ahead;
+
+            // Bytes read into _ahead, invalid if no read is in flight
+            std::future<size_t> _pending;
+
+            // Read next bytes of the run into _ahead on an I/O thread
+            void readAhead();
+
+            // Take length bytes of the run, false if the run ends
+            bool take(char * data, size_t length);
+
+            // Read next block
+            bool readBlock();
+
+        public:
+
+            // Constructor
+            explicit BlockReader(codecMetrics_t * metrics = nullptr);
+
+            // Copy constructor (deleted)
+            BlockReader(const BlockReader<DataType> &) = delete;
+
+            // Move constructor
+            BlockReader(BlockReader<DataType> && o);
+
+            // Copy assignment (deleted)
+            BlockReader<DataType> & operator = (const BlockReader<DataType> &) = delete;
+
+            // Move assignment
+            BlockReader<DataType> & operator = (BlockReader<DataType> && o);
+
+            // Destructor
+            ~BlockReader();
+
+            // Open a run of store
+            bool open(const std::shared_ptr<SegmentStore> & store, size_t run);
+
+            // True if a run is opened
+            bool isValid() const;
+
+            // Read a record, false if the run ends or failed
+            bool read(DataType & v);
+
+            // Close the run
+            void close();
+    };
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Encode buffered records as a block
+    template <typename DataType>
+    bool BlockWriter<DataType>::flushBlock() {
+
+        if (_count == 0) {
+            return true;
+        }
+
+        encodeBlock(_block, _count, _codec, _encoded, _metrics, _firstKey);
+        _block.clear();
+        _count = 0;
+
+        if (_encoded.size() >= RUN_IO_BUFFER_SIZE) {
+            return flushEncoded();
+        }
+
+        return true;
+
+    }
+
+    // Append encoded blocks to the run
+    template <typename DataType>
+    bool BlockWriter<DataType>::flushEncoded() {
+
+        if (_encoded.empty()) {
+            return true;
+        }
+
+        bool ret = _store->append(_run, _encoded.data(), _encoded.size());
+        _encoded.clear();
+
+        return ret;
+
+    }
+
+    // Constructor
+    template <typename DataType>
+    BlockWriter<DataType>::BlockWriter(uint32_t codec, codecMetrics_t * metrics)
+    : _run{0}, _codec{codec}, _metrics{metrics}, _count{0}, _firstKey{0} {}
+
+    // Destructor
+    template <typename DataType>
+    BlockWriter<DataType>::~BlockWriter() {
+
+        close();
+
+    }
+
+    // Open a run (created empty) of store
+    template <typename DataType>
+    bool BlockWriter<DataType>::open(const std::shared_ptr<SegmentStore> & store, size_t run) {
+
+        close();
+
+        _store = store;
+        _run = run;
+        _block.reserve(RECORD_BLOCK_SIZE + BUFFER_SIZE);
+        _encoded.reserve(RUN_IO_BUFFER_SIZE + MAX_RECORD_BLOCK_SIZE);
+
+        return isValid();
+
+    }
+
+    // True if a run is opened
+    template <typename DataType>
+    inline bool BlockWriter<DataType>::isValid() const {
+
+        return (_store != nullptr);
+
+    }
+
+    // Write a record
+    template <typename DataType>
+    bool BlockWriter<DataType>::write(const DataType & v) {
+
+        if (_count == 0) {
+            v.sortPrefix(_firstKey);
+        }
+
+        v.pack(_block);
+        ++_count;
+
+        if (_block.size() >= RECORD_BLOCK_SIZE) {
+            return flushBlock();
+        }
+
+        return true;
+
+    }
+
+    // Write a serialized record with its sort prefix
+    template <typename DataType>
+    bool BlockWriter<DataType>::writePacked(const char * data, size_t length, uint64_t prefix) {
+
+        if (_count == 0) {
+            _firstKey = prefix;
+        }
+
+        _block.append(data, length);
+        ++_count;
+
+        if (_block.size() >= RECORD_BLOCK_SIZE) {
+            return flushBlock();
+        }
+
+        return true;
+
+    }
+
+    // Flush and close the run
+    template <typename DataType>
+    bool BlockWriter<DataType>::close() {
+
+        if (!isValid()) {
+            return true;
+        }
+
+        bool ret = flushBlock();
+
+        ret = flushEncoded() && ret;
+        _store.reset();
+        _block.clear();
+        _encoded.clear();
+        _count = 0;
+
+        return ret;
+
+    }
+
+    // Read next bytes of the run into _ahead on an I/O thread
+    template <typename DataType>
+    inline void BlockReader<DataType>::readAhead() {
+
+        _pending = _store->readAhead(_run, _offset, _ahead.data(), _ahead.size());
+
+    }
+
+    // Take length bytes of the run, false if the run ends
+    template <typename DataType>
+    bool BlockReader<DataType>::take(char * data, size_t length) {
+
+        while (length > 0) {
+            if (_begin == _end) {
+                if (!_pending.valid()) {
+                    return false;
+                }
+
+                // Wait for the bytes read ahead and ask for the following ones
+                _begin = 0;
+                _end = _pending.get();
+
+                if (_end == SEGMENT_READ_ERROR) {
+                    _end = 0;
+                    E("(BlockReader) Fail to read run.");
+                    return false;
+                }
+
+                _buffer.swap(_ahead);
+                _offset += _end;
+
+                if (_end == 0) {
+                    return false;
+                }
+                readAhead();
+            }
+
+            const size_t l = MIN_VAL(length, _end - _begin);
+            memcpy(data, _buffer.data() + _begin, l);
+            _begin += l;
+            data += l;
+            length -= l;
+        }
+
+        return true;
+
+    }
+
+    // Read next block
+    template <typename DataType>
+    bool BlockReader<DataType>::readBlock() {
+
+        blockHeader_t header;
+
+        do {
+            if (!take(reinterpret_cast<char *>(&header), sizeof(blockHeader_t))) {
+                return false;
+            }
+
+            if (header.storedLength > MAX_RECORD_BLOCK_SIZE ||
+                header.rawLength > MAX_RECORD_BLOCK_SIZE) {
+                E("(BlockReader) Corrupted block header.");
+                return false;
+            }
+
+            _payload.resize(header.storedLength);
+            if (!take(&_payload[0], header.storedLength) ||
+                !decodeBlock(header, _payload.data(), _raw, _metrics)) {
+                return false;
+            }
+        } while (header.count == 0);
+
+        _cursor = _raw.data();
+        _remain = header.count;
+
+        return true;
+
+    }
+
+    // Constructor
+    template <typename DataType>
+    BlockReader<DataType>::BlockReader(codecMetrics_t * metrics)
+    : _run{0}, _offset{0}, _metrics{metrics}, _cursor{nullptr}, _remain{0}, _begin{0}, _end{0} {}
+
+    // Move constructor
+    template <typename DataType>
+    BlockReader<DataType>::BlockReader(BlockReader<DataType> && o)
+    : _store{std::move(o._store)}, _run{o._run}, _offset{o._offset}, _metrics{o._metrics},
+      _payload{std::move(o._payload)}, _raw{std::move(o._raw)}, _cursor{o._cursor},
+      _remain{o._remain}, _buffer{std::move(o._buffer)}, _begin{o._begin}, _end{o._end},
+      _ahead{std::move(o._ahead)}, _pending{std::move(o._pending)} {
+
+        o._store.reset();
+        o._remain = 0;
+        o._begin = o._end = 0;
+
+    }
+
+    // Move assignment
+    template <typename DataType>
+    BlockReader<DataType> & BlockReader<DataType>::operator = (BlockReader<DataType> && o) {
+
+        close();
+
+        _store = std::move(o._store);
+        _run = o._run;
+        _offset = o._offset;
+        _metrics = o._metrics;
+        _payload = std::move(o._payload);
+        _raw = std::move(o._raw);
+        _cursor = o._cursor;
+        _remain = o._remain;
+        _buffer = std::move(o._buffer);
+        _begin = o._begin;
+        _end = o._end;
+        _ahead = std::move(o._ahead);
+        _pending = std::move(o._pending);
+
+        o._store.reset();
+        o._remain = 0;
+        o._begin = o._end = 0;
+
+        return *this;
+
+    }
+
+    // Destructor
+    template <typename DataType>
+    BlockReader<DataType>::~BlockReader() {
+
+        close();
+
+    }
+
+    // Open a run of store
+    template <typename DataType>
+    bool BlockReader<DataType>::open(const std::shared_ptr<SegmentStore> & store, size_t run) {
+
+        close();
+
+        _store = store;
+        _run = run;
+        _offset = 0;
+        _buffer.resize(RUN_IO_BUFFER_SIZE);
+        _ahead.resize(RUN_IO_BUFFER_SIZE);
+
+        if (isValid()) {
+            readAhead();
+        }
+
+        return isValid();
+
+    }
+
+    // True if a run is opened
+    template <typename DataType>
+    inline bool BlockReader<DataType>::isValid() const {
+
+        return (_store != nullptr);
+
+    }
+
+    // Read a record, false if the run ends or failed
+    template <typename DataType>
+    bool BlockReader<DataType>::read(DataType & v) {
+
+        if (!isValid()) {
+            return false;
+        }
+
+        if (_remain == 0 && !readBlock()) {
+            return false;
+        }
+
+        if (!v.unpack(_cursor, _raw.data() + _raw.size())) {
+            E("(BlockReader) Corrupted record.");
+            _remain = 0;
+            return false;
+        }
+        --_remain;
+
+        return true;
+
+    }
+
+    // Close the run
+    template <typename DataType>
+    void BlockReader<DataType>::close() {
+
+        // _ahead is written till the read ends
+        if (_pending.valid()) {
+            _pending.wait();
+            _pending = std::future<size_t>();
+        }
+
+        _store.reset();
+        _remain = 0;
+        _begin = _end = 0;
+
+    }
+}
+
+#endif
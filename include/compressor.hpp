@@ -0,0 +1,59 @@
+/*
+ * Block compression for shuffle streams and temporary files
+ */
+
+#ifndef COMPRESSOR_H
+#define COMPRESSOR_H
+
+#include <stdint.h>    // uint32_t, uint64_t
+
+#include <string>      // string
+
+#include "def.hpp"     // CODEC_xxx
+#include "metrics.hpp" // codecMetrics_t
+
+namespace ch {
+
+    /*
+     * blockHeader_t: header of a block of serialized records
+     */
+    struct blockHeader_t {
+
+        // Length of the serialized records
+        uint32_t rawLength;
+
+        // Length of the payload following the header
+        uint32_t storedLength;
+
+        // Number of records in the block
+        uint32_t count;
+
+        // Codec of the payload
+        uint32_t codec;
+
+        // Sort prefix of the first record (0 if not given)
+        uint64_t firstKey;
+    };
+
+    // Upper bound of the compressed length of len bytes
+    size_t compressBound(size_t len);
+
+    // Compress len bytes from src to dst
+    // return compressed length, 0 if capacity is less than compressBound(len)
+    size_t lzCompress(const char * src, size_t len, char * dst, size_t capacity);
+
+    // Decompress len bytes from src to exactly rawLength bytes in dst
+    bool lzDecompress(const char * src, size_t len, char * dst, size_t rawLength);
+
+    // Append block (header and payload) of count serialized records to out
+    // fall back to CODEC_NONE if the block is not compressible
+    void encodeBlock(const std::string & raw, uint32_t count, uint32_t codec,
+                     std::string & out, codecMetrics_t * metrics = nullptr,
+                     uint64_t firstKey = 0);
+
+    // Decode payload of a block to serialized records
+    bool decodeBlock(const blockHeader_t & header, const char * payload,
+                     std::string & raw, codecMetrics_t * metrics = nullptr);
+}
+
+#endif
@@ -7,12 +7,22 @@
 
 #include <vector>               // vector
 #include <string>               // string
-#include <mutex>                // mutex, lock_guard
-#include <algorithm>            // sort
-
+#include <mutex>                // mutex, lock_guard, unique_lock
+#include <condition_variable>   // condition_variable
+#include <thread>               // thread
+#include <atomic>               // atomic_bool, atomic
+#include <memory>               // unique_ptr
+#include <deque>                // deque
+
+#include "options.hpp"          // options_t
+#include "metrics.hpp"          // Metrics
 #include "localFileManager.hpp" // LocalFileManager
+#include "recordArena.hpp"      // RecordArena
+#include "sorter.hpp"           // sortRecords
+#include "runReader.hpp"        // RunReader, MemoryRunReader, ArenaRunReader
 #include "sortedStream.hpp"     // SortedStream
 #include "unsortedStream.hpp"   // UnsortedStream
+#include "hashAggregator.hpp"   // HashAggregator
 
 namespace ch {
 
@@ -28,28 +38,144 @@ namespace ch {
             // Sort the data before dumping to file
             bool _presort;
 
-            // Dump to file if data length exceed the threshold
+            // Dump to file if data length reach the threshold (0: no limit)
             const size_t _maxDataSize;
 
-            // Data it manages
-            std::vector<const DataType *> _data;
+            // Dump to file if bytes in memory of the job exceed the budget (0: no limit)
+            const size_t _memoryBudget;
+
+            // Bytes in memory of the job (_ownMemory without metrics)
+            memoryMetrics_t * _memory;
+            memoryMetrics_t _ownMemory;
+
+            // Keep data serialized in arenas instead of vectors of records
+            const bool _arenaStorage;
+
+            /*
+             * Records stored by a group of threads, dumped independently of other shards
+             */
+            struct shard_t {
+                std::mutex lock;                          // lock of the records in memory
+                std::vector<const DataType *> data;       // records (vector storage)
+                RecordArena<DataType> arena;              // records (arena storage)
+                size_t bytes;                             // bytes of the records
+                std::vector<const DataType *> spillData;  // records handed to the spill thread
+                RecordArena<DataType> spillArena;         // (arena storage)
+                size_t spillBytes;                        // bytes of the handed records
+                bool spillPending;                        // handed and not dumped yet
 
-            // Data lock
-            std::mutex _dataLock;
+                shard_t(): bytes{0}, spillBytes{0}, spillPending{false} {}
+            };
+
+            // Shards, a storing thread always uses the same one
+            std::vector<std::unique_ptr<shard_t> > _shards;
+
+            // Number of records stored since data were last handed out as a stream
+            std::atomic<size_t> _stored;
 
             // Manages temporary files
             LocalFileManager<DataType> fileManager;
 
+            // Merge sorted temporary files in background
+            const bool _backgroundMerge;
+
+            // Background merge thread, started by the first dump
+            std::thread * _merger;
+
+            // Lock and condition of the merge thread
+            std::mutex _mergeLock;
+            std::condition_variable _mergeCond;
+
+            // True if the merge thread should exit
+            bool _stopMerge;
+
+            // True if a background merge failed
+            std::atomic_bool _mergeFailed;
+
+            // Dump full data on a background thread (double buffering)
+            const bool _asyncSpill;
+
+            // Shards whose data is handed to the spill thread, in order of hand off
+            std::deque<shard_t *> _spillQueue;
+
+            // Spill thread, started by the first hand off
+            std::thread * _spiller;
+
+            // Lock and condition of the spill thread
+            std::mutex _spillLock;
+            std::condition_variable _spillCond;
+
+            // True if the spill thread should exit
+            bool _stopSpill;
+
+            // True if a background spill failed
+            std::atomic_bool _spillFailed;
+
+            // Threads sorting data before dumping (0: all cores)
+            const size_t _sortThreads;
+
+            // Hand data in memory out as runs instead of dumping it when streams are taken
+            const bool _memoryRuns;
+
+            // Records stored are combined by key in _aggregator instead of being sorted
+            bool _aggregate;
+
+            // Hash aggregate of records stored, handed out as the sorted stream
+            std::unique_ptr<HashAggregator<DataType> > _aggregator;
+
+            // Spill thread: sort and dump data handed off by the storing threads
+            void spillLoop();
+
+            // Hand data of a shard to the spill thread, wait if its last hand off is not dumped
+            bool handOff(shard_t & shard);
+
+            // Stop spill thread after the pending spill
+            void stopSpiller();
+
+            // Merge thread: merge as many runs of the same level as the file manager merges at
+            // once whenever there are so many, so that few runs remain to merge when receiving ends
+            void mergeLoop();
+
+            // Wake up merge thread after a dump, start it if needed
+            void notifyMerger();
+
+            // Stop merge thread after the current merge
+            void stopMerger();
+
+            // Shard of the calling thread
+            shard_t & getShard();
+
+            // Number of records of a shard in memory
+            size_t inMemory(const shard_t & shard) const;
+
+            // Dump data or arena (by storage) to file, sorted if sort is true
+            bool writeData(std::vector<const DataType *> & data, RecordArena<DataType> & arena,
+                           bool sort);
+
+            // Dump data of a shard to file, sorted if sort is true
+            bool dumpShard(shard_t & shard, bool sort);
+
+            // Dump data of all shards to file, sorted if sort is true
+            bool dumpShards(bool sort);
+
+            // Hand data of all shards out as runs in memory, sorted if sort is true
+            void takeRuns(bool sort, std::vector<RunReader<DataType> *> & runs);
+
+            // Hand data in memory out as runs or dump it (by _memoryRuns), sorted if sort is true
+            bool finishShards(bool sort, std::vector<RunReader<DataType> *> & runs);
+
+            // Account bytes of a record stored in a shard, dump the shard to file if it reaches
+            // a threshold
+            bool dumpIfFull(shard_t & shard, size_t bytes);
+
             // Clear the data manager
             void clear();
 
-            // Dereference pointer and compare
-            static bool pointerComp (const DataType * l, const DataType * r);
-
         public:
 
             // Constructor
-            explicit DataManager (const std::string & dir, size_t maxDataSize = DEFAULT_MAX_DATA_SIZE, bool presort = true);
+            explicit DataManager (const std::string & dir, const options_t & options = options_t(),
+                                  Metrics * metrics = nullptr, bool presort = true);
 
             // Copy constructor (deleted)
             DataManager(const DataManager<DataType> & ) = delete;
@@ -78,37 +204,365 @@ namespace ch {
             // Get unsorted stream from file manager
             UnsortedStream<DataType> * getUnsortedStream ();
 
+            // Number of records stored since data were last handed out as a stream
+            size_t stored();
+
             void setPresort(bool presort);
+
+            // Combine records by key in a hash table as they are stored, the sorted stream then
+            // holds one record per key in no order (set before data are stored, once)
+            void setAggregate(bool aggregate);
     };
 
     /********************************************
      ************ Implementation ****************
     ********************************************/
 
-    // Clear the data manager
+    // Merge thread: merge as many runs of the same level as the file manager merges at
+    // once whenever there are so many, so that few runs remain to merge when receiving ends
     template <typename DataType>
-    void DataManager<DataType>::clear() {
+    void DataManager<DataType>::mergeLoop() {
 
-        fileManager.clear();
+        std::unique_lock<std::mutex> holder{_mergeLock};
+
+        while (!_stopMerge) {
+            if (!fileManager.hasFullTier(fileManager.mergeWay())) {
+                _mergeCond.wait(holder);
+                continue;
+            }
+
+            holder.unlock();
+
+            if (!fileManager.mergeTier(fileManager.mergeWay())) {
+                E("(DataManager) Background merge failed.");
+                _mergeFailed = true;
+                return;
+            }
+
+            holder.lock();
+        }
+
+    }
+
+    // Wake up merge thread after a dump, start it if needed
+    template <typename DataType>
+    void DataManager<DataType>::notifyMerger() {
+
+        if (!_backgroundMerge || !_presort) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> holder{_mergeLock};
+
+        if (_merger == nullptr) {
+            _stopMerge = false;
+            _merger = new std::thread{&DataManager<DataType>::mergeLoop, this};
+        }
+
+        _mergeCond.notify_one();
+
+    }
+
+    // Stop merge thread after the current merge
+    template <typename DataType>
+    void DataManager<DataType>::stopMerger() {
+
+        {
+            std::lock_guard<std::mutex> holder{_mergeLock};
+
+            if (_merger == nullptr) {
+                return;
+            }
+
+            _stopMerge = true;
+            _mergeCond.notify_one();
+        }
+
+        _merger->join();
+        delete _merger;
+        _merger = nullptr;
+
+    }
+
+    // Spill thread: sort and dump data handed off by the storing threads
+    template <typename DataType>
+    void DataManager<DataType>::spillLoop() {
+
+        std::unique_lock<std::mutex> holder{_spillLock};
+
+        while (true) {
+            if (_spillQueue.empty()) {
+                if (_stopSpill) {
+                    return;
+                }
+                _spillCond.wait(holder);
+                continue;
+            }
+
+            shard_t * shard = _spillQueue.front();
+            _spillQueue.pop_front();
+
+            holder.unlock();
+
+            if (writeData(shard->spillData, shard->spillArena, _presort)) {
+                notifyMerger();
+            } else {
+                E("(DataManager) Background spill failed.");
+                _spillFailed = true;
+            }
+            _memory->release(shard->spillBytes);
+            _memory->spilling -= shard->spillBytes;
+
+            holder.lock();
+
+            shard->spillPending = false;
+            _spillCond.notify_all();
+        }
+
+    }
+
+    // Hand data of a shard to the spill thread, wait if its last hand off is not dumped
+    template <typename DataType>
+    bool DataManager<DataType>::handOff(shard_t & shard) {
+
+        std::unique_lock<std::mutex> holder{_spillLock};
+
+        while (shard.spillPending) {
+            _spillCond.wait(holder);
+        }
+
+        if (_spillFailed) {
+            return false;
+        }
+
+        if (_arenaStorage) {
+            shard.spillArena.swap(shard.arena);
+        } else {
+            shard.spillData.swap(shard.data);
+        }
+        shard.spillBytes = shard.bytes;
+        shard.bytes = 0;
+        shard.spillPending = true;
+        _memory->spilling += shard.spillBytes;
+        _memory->addSpill(shard.spillBytes);
+        _spillQueue.push_back(&shard);
+
+        if (_spiller == nullptr) {
+            _stopSpill = false;
+            _spiller = new std::thread{&DataManager<DataType>::spillLoop, this};
+        }
+
+        _spillCond.notify_all();
+
+        return true;
+
+    }
+
+    // Stop spill thread after the pending spill
+    template <typename DataType>
+    void DataManager<DataType>::stopSpiller() {
+
+        {
+            std::lock_guard<std::mutex> holder{_spillLock};
+
+            if (_spiller == nullptr) {
+                return;
+            }
+
+            _stopSpill = true;
+            _spillCond.notify_all();
+        }
+
+        _spiller->join();
+        delete _spiller;
+        _spiller = nullptr;
+
+    }
+
+    // Shard of the calling thread
+    template <typename DataType>
+    inline typename DataManager<DataType>::shard_t & DataManager<DataType>::getShard() {
+
+        return *(_shards[threadIndex() % _shards.size()]);
+
+    }
+
+    // Number of records of a shard in memory
+    template <typename DataType>
+    inline size_t DataManager<DataType>::inMemory(const shard_t & shard) const {
+
+        return _arenaStorage ? shard.arena.size() : shard.data.size();
+
+    }
+
+    // Dump data or arena (by storage) to file, sorted if sort is true
+    template <typename DataType>
+    bool DataManager<DataType>::writeData(std::vector<const DataType *> & data,
+                                          RecordArena<DataType> & arena, bool sort) {
+
+        if (_arenaStorage) {
+            if (sort) arena.sort();
+            return fileManager.dumpToFile(arena);
+        }
+
+        if (sort) sortRecords(data, _sortThreads);
+        return fileManager.dumpToFile(data);
+
+    }
+
+    // Dump data of a shard to file, sorted if sort is true
+    template <typename DataType>
+    bool DataManager<DataType>::dumpShard(shard_t & shard, bool sort) {
+
+        _memory->addSpill(shard.bytes);
+        _memory->release(shard.bytes);
+        shard.bytes = 0;
+
+        return writeData(shard.data, shard.arena, sort);
+
+    }
+
+    // Dump data of all shards to file, sorted if sort is true
+    template <typename DataType>
+    bool DataManager<DataType>::dumpShards(bool sort) {
+
+        for (std::unique_ptr<shard_t> & shard: _shards) {
+            std::lock_guard<std::mutex> holder{shard->lock};
+
+            if (inMemory(*shard) != 0 && !dumpShard(*shard, sort)) {
+                E("(DataManager) Fail to dump the remaining data to file.");
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+    // Hand data of all shards out as runs in memory, sorted if sort is true
+    template <typename DataType>
+    void DataManager<DataType>::takeRuns(bool sort, std::vector<RunReader<DataType> *> & runs) {
+
+        for (std::unique_ptr<shard_t> & shard: _shards) {
+            std::lock_guard<std::mutex> holder{shard->lock};
+
+            if (inMemory(*shard) == 0) {
+                continue;
+            }
+
+            // Bytes stay accounted till the run is destroyed
+            if (_arenaStorage) {
+                if (sort) shard->arena.sort();
+                runs.push_back(new ArenaRunReader<DataType>{shard->arena, _memory, shard->bytes});
+            } else {
+                if (sort) sortRecords(shard->data, _sortThreads);
+                runs.push_back(new MemoryRunReader<DataType>{shard->data, _memory, shard->bytes});
+            }
+            shard->bytes = 0;
+        }
+
+    }
+
+    // Hand data in memory out as runs or dump it (by _memoryRuns), sorted if sort is true
+    template <typename DataType>
+    bool DataManager<DataType>::finishShards(bool sort, std::vector<RunReader<DataType> *> & runs) {
+
+        stopSpiller();
+        stopMerger();
+
+        if (_spillFailed || _mergeFailed) {
+            return false;
+        }
+
+        if (_memoryRuns) {
+            takeRuns(sort, runs);
+        } else if (!dumpShards(sort)) {
+            return false;
+        }
+
+        _stored = 0;
+
+        return true;
+
+    }
 
-        std::lock_guard<std::mutex> holder{_dataLock};
+    // Account bytes of a record stored in a shard, dump the shard to file if it reaches
+    // a threshold
+    template <typename DataType>
+    bool DataManager<DataType>::dumpIfFull(shard_t & shard, size_t bytes) {
+
+        shard.bytes += bytes;
+
+        const size_t total = _memory->reserve(bytes);
+
+        // Data being spilled in background has the other half of the budget, only the data
+        // filling up counts against this one (released first, so spilling may exceed total)
+        const size_t spilling = _memory->spilling;
+        const size_t filling = (total > spilling) ? total - spilling : 0;
+        const size_t budget = _asyncSpill ? _memoryBudget / 2 : _memoryBudget;
+
+        // Small holders do not spill for the budget, the largest ones soon exceed MIN_SPILL_SIZE
+        const bool overBudget = (budget != 0 && filling > budget &&
+                                 shard.bytes >= MIN_VAL(budget, MIN_SPILL_SIZE));
+
+        if (overBudget || inMemory(shard) == _maxDataSize) {
+            if (_asyncSpill) {
+                return handOff(shard);
+            }
+            if (!dumpShard(shard, _presort)) {
+                return false;
+            }
+            notifyMerger();
+        }
 
-        _data.clear();
+        return true;
 
     }
 
-    // Dereference pointer and compare
+    // Clear the data manager
     template <typename DataType>
-    bool DataManager<DataType>::pointerComp (const DataType * l, const DataType * r) {
+    void DataManager<DataType>::clear() {
+
+        stopSpiller();
+        stopMerger();
+
+        fileManager.clear();
+
+        for (std::unique_ptr<shard_t> & shard: _shards) {
+            std::lock_guard<std::mutex> holder{shard->lock};
 
-        return (*l) < (*r);
+            shard->data.clear();
+            shard->arena.clear();
+
+            _memory->release(shard->bytes);
+            shard->bytes = 0;
+        }
+
+        _stored = 0;
 
     }
 
     // Constructor
     template <typename DataType>
-    DataManager<DataType>::DataManager (const std::string & dir, size_t maxDataSize, bool presort)
-    : _presort{presort}, _maxDataSize{maxDataSize}, fileManager{dir} {}
+    DataManager<DataType>::DataManager (const std::string & dir, const options_t & options,
+                                        Metrics * metrics, bool presort)
+    : _presort{presort}, _maxDataSize{options.maxDataSize}, _memoryBudget{options.memoryBudget},
+      _memory{(metrics == nullptr) ? &_ownMemory : &(metrics->memory)},
+      _arenaStorage{options.arenaStorage}, _stored{0},
+      fileManager{dir, options.spillCodec, (metrics == nullptr) ? nullptr : &(metrics->spill),
+                  options.memoryBudget, options.mergeThreads},
+      _backgroundMerge{options.backgroundMerge}, _merger{nullptr}, _stopMerge{false},
+      _mergeFailed{false}, _asyncSpill{options.asyncSpill}, _spiller{nullptr}, _stopSpill{false},
+      _spillFailed{false}, _sortThreads{options.sortThreads},
+      _memoryRuns{options.memoryRuns}, _aggregate{false},
+      _aggregator{new HashAggregator<DataType>{
+          dir, options, _memory, (metrics == nullptr) ? nullptr : &(metrics->spill)}} {
+
+        for (size_t i = 0, n = MAX_VAL(options.storeShards, 1); i < n; ++i) {
+            _shards.emplace_back(new shard_t{});
+        }
+
+    }
 
     // Destructor
     template <typename DataType>
@@ -122,16 +576,29 @@ namespace ch {
     template <typename DataType>
     bool DataManager<DataType>::store(const DataType * v) {
 
-        std::lock_guard<std::mutex> holder{_dataLock};
+        if (_aggregate) {
+            const bool ret = _aggregator->add(*v);
+            delete v;
+            ++_stored;
+            return ret;
+        }
+
+        shard_t & shard = getShard();
+
+        std::lock_guard<std::mutex> holder{shard.lock};
 
-        _data.push_back(v);
+        size_t bytes;
 
-        if (_data.size() == _maxDataSize) {
-            if (_presort) sort(std::begin(_data), std::end(_data), pointerComp);
-            return fileManager.dumpToFile(_data);
+        if (_arenaStorage) {
+            bytes = shard.arena.add(*v);
+            delete v;
+        } else {
+            bytes = v->footprint() + sizeof(const DataType *);
+            shard.data.push_back(v);
         }
+        ++_stored;
 
-        return true;
+        return dumpIfFull(shard, bytes);
 
     }
 
@@ -139,18 +606,30 @@ namespace ch {
     template <typename DataType>
     bool DataManager<DataType>::store(const DataType & v) {
 
-        DataType * nv = new DataType{v};
+        if (_aggregate) {
+            ++_stored;
+            return _aggregator->add(v);
+        }
 
-        std::lock_guard<std::mutex> holder{_dataLock};
+        shard_t & shard = getShard();
 
-        _data.push_back(nv);
+        if (_arenaStorage) {
+            std::lock_guard<std::mutex> holder{shard.lock};
 
-        if (_data.size() == _maxDataSize) {
-            if (_presort) sort(std::begin(_data), std::end(_data), pointerComp);
-            return fileManager.dumpToFile(_data);
+            const size_t bytes = shard.arena.add(v);
+            ++_stored;
+
+            return dumpIfFull(shard, bytes);
         }
 
-        return true;
+        DataType * nv = new DataType{v};
+
+        std::lock_guard<std::mutex> holder{shard.lock};
+
+        shard.data.push_back(nv);
+        ++_stored;
+
+        return dumpIfFull(shard, nv->footprint() + sizeof(const DataType *));
 
     }
 
@@ -162,17 +641,30 @@ namespace ch {
             return nullptr;
         }
 
-        std::lock_guard<std::mutex> holder{_dataLock};
+        // The aggregate is the only run, nothing is merged
+        if (_aggregate) {
+            SortedStream<DataType> * ret = new SortedStream<DataType>;
 
-        if (_data.size() != 0) {
-            sort(std::begin(_data), std::end(_data), pointerComp);
-            if (!fileManager.dumpToFile(_data)) {
-                E("(DataManager) Fail to dump the remaining data to file.");
+            ret->addRun(_aggregator.release());
+            _aggregate = false;
+            _stored = 0;
+
+            if (!ret->isValid()) {
+                delete ret;
                 return nullptr;
             }
+
+            return ret;
         }
 
-        return fileManager.getSortedStream();
+        std::vector<RunReader<DataType> *> runs;
+
+        // Merge of the remaining files is done by the file manager
+        if (!finishShards(true, runs)) {
+            return nullptr;
+        }
+
+        return fileManager.getSortedStream(runs);
 
     }
 
@@ -180,16 +672,21 @@ namespace ch {
     template <typename DataType>
     UnsortedStream<DataType> * DataManager<DataType>::getUnsortedStream () {
 
-        std::lock_guard<std::mutex> holder{_dataLock};
+        std::vector<RunReader<DataType> *> runs;
 
-        if (_data.size() != 0) {
-            if (!fileManager.dumpToFile(_data)) {
-                E("(DataManager) Fail to dump the remaining data to file.");
-                return nullptr;
-            }
+        if (!finishShards(false, runs)) {
+            return nullptr;
         }
 
-        return fileManager.getUnsortedStream();
+        return fileManager.getUnsortedStream(runs);
+
+    }
+
+    // Number of records stored since data were last handed out as a stream
+    template <typename DataType>
+    size_t DataManager<DataType>::stored() {
+
+        return _stored;
 
     }
 
@@ -199,6 +696,14 @@ namespace ch {
         _presort = presort;
 
     }
+
+    // Combine records by key in a hash table as they are stored
+    template <typename DataType>
+    void DataManager<DataType>::setAggregate(bool aggregate) {
+
+        _aggregate = aggregate && (_aggregator != nullptr);
+
+    }
 }
 
 #endif
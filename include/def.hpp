@@ -54,6 +54,38 @@ P(tss.str().c_str())
 #define ID_INTEGER '\x1'
 #define ID_STRING '\x2'
 
+// Block compression codecs
+#define CODEC_NONE 0
+#define CODEC_LZ 1
+
+// Where reducer output is written
+#define OUTPUT_SINGLE 0 // one text file on master
+#define OUTPUT_PARTS 1 // one part file per machine under the output directory
+
+// How records in memory are sorted
+#define SORT_COMPARE 0 // comparison sort of any type
+#define SORT_INTEGER 1 // LSD radix sort of Integer keys
+#define SORT_STRING 2 // MSD radix sort of String keys
+
+// How map output is partitioned between machines
+#define PARTITION_HASH 0 // by hash code of key
+#define PARTITION_RANGE 1 // by key range chosen from a sample, machine i holds smaller keys than i + 1
+
+// How records are written as lines of text output
+#define TEXT_REPR 0 // as toString, e.g. ("word", 3)
+#define TEXT_CSV 1 // fields separated by commas, strings quoted if needed (RFC 4180)
+#define TEXT_TSV 2 // fields separated by tabs, tabs, newlines and backslashes in strings escaped
+
+// How records of a key are brought together for reducer
+#define REDUCE_SORT 0 // sorted and merged, groups in order of key
+#define REDUCE_HASH 1 // combined in a hash table as they are received, one record per key in no order
+
+// Kind of frames on shuffle mesh
+#define MESH_HELLO 0
+#define MESH_DATA 1
+#define MESH_CLOSE 2
+#define MESH_RESET 3 // channel dropped by the receiver, the sender fails
+
 // RPC symbols
 #define CALL_MASTER 'M'
 #define CALL_WORKER 'W'
@@ -81,19 +113,52 @@ P(tss.str().c_str())
 #define TEMP_DIR "/.CHost"
 #define IPCONFIG_FILE "/ipconfig"
 #define JOB_FILE "/job"
+#define PART_FILE_PREFIX "/part-"
+#define MANIFEST_FILE "/_manifest"
+#define RECORD_FILE_MAGIC "CHRECS01" // first bytes of a file of serialized records (binary output)
 #define LOCALHOST "127.0.0.1"
 
 #define RANDOM_FILE_NAME_LENGTH 8
 #define RANDOM_JOB_NAME_LENGTH 5
-#define DEFAULT_MAX_DATA_SIZE 1000000
-#define MERGE_SORT_WAY 16
+#define DEFAULT_MAX_DATA_SIZE 0 // no limit of records in memory, only the memory budget
+#define DEFAULT_MEMORY_BUDGET (256 << 20) // bytes of records in memory per job before spilling
+#define MIN_SPILL_SIZE (1 << 20) // bytes a data manager holds at least before it spills for the budget
+#define MIN_MERGE_WAY 8 // fewest runs merged at once, however small the memory budget
+#define MAX_MERGE_WAY 256 // most runs merged at once
+#define MERGE_RUN_MEMORY (2 * RUN_IO_BUFFER_SIZE + 2 * RECORD_BLOCK_SIZE) // bytes a run takes while merged
+#define DEFAULT_STORE_SHARDS 4 // buffers of a data manager storing threads are spread over
+#define PARALLEL_SORT_MIN 65536 // records per thread at least when sorting data in memory
+#define RADIX_SORT_MIN 64 // ranges of fewer records are sorted by comparison
+#define MSD_RADIX_MAX_LEVEL 32 // nested calls of MSD radix sort, deeper ranges are sorted by comparison
+#define DEFAULT_RANGE_SAMPLES 1000 // records sampled per machine to choose key ranges
+#define DEFAULT_SKEW_SAMPLES 10000 // first records of map output counted per machine to find hot keys
+#define DEFAULT_HOT_KEY_SHARE 0.01 // share of the samples making a key hot
 #define OPEN_FILESTREAM_RETRY_INTERVAL 60 // seconds
 #define CONNECTION_RETRY_INTERVAL 1 // seconds
 #define ACCEPT_TIMEOUT 5 // seconds
 #define RECEIVE_TIMEOUT 5 // seconds
+#define CREDIT_TIMEOUT 300 // seconds a sender waits for a credit grant before it fails
 #define MAX_CONNECTION_ATTEMPT 15
 #define BUFFER_SIZE 1024
 #define DATA_BLOCK_SIZE 65536
+#define RECORD_BLOCK_SIZE 65536 // serialized records per block (shuffle/temporary file)
+#define RUN_IO_BUFFER_SIZE (2 << 20) // bytes read/written at once on temporary files
+#define TEXT_WRITE_BUFFER_SIZE (1 << 20) // bytes of text output formatted before they are written
+#define ARENA_CHUNK_SIZE (1 << 20) // bytes of a chunk of serialized records in memory
+#define SEGMENT_GROW_SIZE (64 << 20) // bytes the segment store file is preallocated by
+#define SEGMENT_READ_ERROR static_cast<size_t>(-1) // returned by a failed read of a segment store
+#define READ_AHEAD_THREADS 1 // I/O threads of a segment store read by one reader at a time
+#define HASH_SPILL_PARTITIONS 16 // runs a hash aggregate over the memory budget is spilled to, by key
+#define HASH_MAX_LEVEL 4 // times a spilled hash partition over the memory budget is split again
+#define HASH_ENTRY_OVERHEAD (4 * sizeof(void *)) // bytes of a hash table entry besides its record
+#define MAX_RECORD_BLOCK_SIZE (64 << 20) // sanity limit of a received block
+#define DEFAULT_SHUFFLE_CREDITS 8 // blocks in flight per connection, 0 disables flow control
+#define DEFAULT_MAX_DEFERRED_SIZE (64 << 20) // bytes of blocks held in memory for lack of credits
+#define MESH_FRAME_SIZE 65536 // max payload of a frame on shuffle mesh
+#define MESH_MAX_KEY_LENGTH 4096
+#define MESH_MAX_PENDING (4 << 20) // bytes queued to a peer before reading channels pauses
+#define MESH_MAX_BUFFERED (4 << 20) // bytes from a peer held for a channel before reading the peer pauses
+#define MESH_OPEN_TIMEOUT 120 // seconds a channel a peer sends to may wait to be opened by a job
 #define THREAD_POOL_SIZE 4
 #define NUM_MAPPER 4
 
@@ -0,0 +1,226 @@
+/*
+ * Iterate a sorted stream by key: each distinct key once, then its values read from the merge
+ */
+
+#ifndef GROUPITERATOR_H
+#define GROUPITERATOR_H
+
+#include "sortedStream.hpp" // SortedStream
+#include "recordOrder.hpp"  // recordGroup_t
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    template <typename DataType>
+    class ValueRange;
+
+    /*
+     * GroupIterator: groups of records with equal keys (recordGroup_t) of a sorted stream
+     * Usage: while (groups.nextKey(res)) { for (const auto & e: groups.values()) res += e; }
+     */
+    template <typename DataType>
+    class GroupIterator {
+
+        protected:
+
+            // Stream it reads
+            SortedStream<DataType> & _stream;
+
+            // Key of current group (copy of its first record)
+            DataType _key;
+
+            // True if a group is started
+            bool _started;
+
+        public:
+
+            // Constructor
+            explicit GroupIterator(SortedStream<DataType> & stream);
+
+            // Copy constructor (deleted)
+            GroupIterator(const GroupIterator<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            GroupIterator<DataType> & operator = (const GroupIterator<DataType> &) = delete;
+
+            // Start next group, first is its first record (values left in current group are
+            // skipped), false if the stream ends
+            bool nextKey(DataType & first);
+
+            // Next record of current group after the first, false if the group ends
+            bool nextValue(DataType & v);
+
+            // Remaining records of current group, read lazily
+            ValueRange<DataType> values();
+    };
+
+    /*
+     * ValueRange: remaining records of the current group of a GroupIterator, as an input range
+     */
+    template <typename DataType>
+    class ValueRange {
+
+        protected:
+
+            // Groups it reads
+            GroupIterator<DataType> & _groups;
+
+        public:
+
+            /*
+             * Iterator: holds the current record, end if the group ends
+             */
+            class Iterator {
+
+                protected:
+
+                    // Groups it reads, nullptr for end
+                    GroupIterator<DataType> * _groups;
+
+                    // Current record
+                    DataType _value;
+
+                    // True if the group ends
+                    bool _end;
+
+                public:
+
+                    // Constructor: read first record (end iterator if groups is nullptr)
+                    explicit Iterator(GroupIterator<DataType> * groups);
+
+                    // Current record
+                    DataType & operator * ();
+
+                    // Read next record
+                    Iterator & operator ++ ();
+
+                    // True unless both are at the end
+                    bool operator != (const Iterator & o) const;
+            };
+
+            // Constructor
+            explicit ValueRange(GroupIterator<DataType> & groups);
+
+            // Iterator at the next record
+            Iterator begin();
+
+            // End iterator
+            Iterator end();
+    };
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Constructor
+    template <typename DataType>
+    GroupIterator<DataType>::GroupIterator(SortedStream<DataType> & stream)
+    : _stream(stream), _started{false} {}
+
+    // Start next group, first is its first record (values left in current group are
+    // skipped), false if the stream ends
+    template <typename DataType>
+    bool GroupIterator<DataType>::nextKey(DataType & first) {
+
+        if (_started) {
+            DataType skipped;
+            while (nextValue(skipped)) {}
+        }
+
+        if (!_stream.get(first)) {
+            _started = false;
+            return false;
+        }
+
+        _key = first;
+        _started = true;
+
+        return true;
+
+    }
+
+    // Next record of current group after the first, false if the group ends
+    template <typename DataType>
+    bool GroupIterator<DataType>::nextValue(DataType & v) {
+
+        const DataType * next = _stream.peek();
+
+        if (!_started || next == nullptr || !recordGroup_t<DataType>::equal(*next, _key)) {
+            return false;
+        }
+
+        return _stream.get(v);
+
+    }
+
+    // Remaining records of current group, read lazily
+    template <typename DataType>
+    inline ValueRange<DataType> GroupIterator<DataType>::values() {
+
+        return ValueRange<DataType>{*this};
+
+    }
+
+    // Constructor: read first record (end iterator if groups is nullptr)
+    template <typename DataType>
+    ValueRange<DataType>::Iterator::Iterator(GroupIterator<DataType> * groups)
+    : _groups{groups}, _end{true} {
+
+        if (_groups != nullptr) {
+            _end = !_groups->nextValue(_value);
+        }
+
+    }
+
+    // Current record
+    template <typename DataType>
+    inline DataType & ValueRange<DataType>::Iterator::operator * () {
+
+        return _value;
+
+    }
+
+    // Read next record
+    template <typename DataType>
+    inline typename ValueRange<DataType>::Iterator &
+        ValueRange<DataType>::Iterator::operator ++ () {
+
+        _end = !_groups->nextValue(_value);
+
+        return *this;
+
+    }
+
+    // True unless both are at the end
+    template <typename DataType>
+    inline bool ValueRange<DataType>::Iterator::operator != (const Iterator & o) const {
+
+        return _end != o._end;
+
+    }
+
+    // Constructor
+    template <typename DataType>
+    ValueRange<DataType>::ValueRange(GroupIterator<DataType> & groups): _groups(groups) {}
+
+    // Iterator at the next record
+    template <typename DataType>
+    inline typename ValueRange<DataType>::Iterator ValueRange<DataType>::begin() {
+
+        return Iterator{&_groups};
+
+    }
+
+    // End iterator
+    template <typename DataType>
+    inline typename ValueRange<DataType>::Iterator ValueRange<DataType>::end() {
+
+        return Iterator{nullptr};
+
+    }
+}
+
+#endif
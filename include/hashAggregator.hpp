@@ -0,0 +1,416 @@
+/*
+ * Hash aggregation of records by key, read by the reducer instead of a merge of sorted runs
+ */
+
+#ifndef HASHAGGREGATOR_H
+#define HASHAGGREGATOR_H
+
+#include <stdint.h>            // uint64_t
+
+#include <string>              // string
+#include <vector>              // vector
+#include <memory>              // shared_ptr, make_shared
+#include <mutex>               // mutex, lock_guard
+#include <unordered_set>       // unordered_set
+
+#include "def.hpp"             // HASH_SPILL_PARTITIONS, HASH_MAX_LEVEL, HASH_ENTRY_OVERHEAD,
+                               // MIN_SPILL_SIZE, E
+#include "options.hpp"         // options_t
+#include "metrics.hpp"         // codecMetrics_t, memoryMetrics_t
+#include "recordOrder.hpp"     // recordGroup_t, recordCombine_t
+#include "segmentStore.hpp"    // SegmentStore
+#include "blockStream.hpp"     // BlockWriter
+#include "runReader.hpp"       // RunReader, StoreRunReader
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    /*
+     * HashAggregator: one record per group (recordGroup_t) in a hash table, records of a group
+     * are folded into it by recordCombine_t as they are added
+     * Over the memory budget the table is spilled to HASH_SPILL_PARTITIONS runs by hash of key
+     * and emptied; when read, each partition is aggregated in memory on its own, and one still
+     * over the budget is split again by a hash of another seed, so no record is ever sorted.
+     * Records are read in no order.
+     */
+    template <typename DataType>
+    class HashAggregator: public RunReader<DataType> {
+
+        protected:
+
+            /*
+             * hash_t: hash code of key (hashCode caches, so records are not really const)
+             */
+            struct hash_t {
+                size_t operator () (const DataType & v) const {
+                    return static_cast<unsigned int>(const_cast<DataType &>(v).hashCode());
+                }
+            };
+
+            /*
+             * equal_t: records of the same group
+             */
+            struct equal_t {
+                bool operator () (const DataType & l, const DataType & r) const {
+                    return recordGroup_t<DataType>::equal(l, r);
+                }
+            };
+
+            typedef std::unordered_set<DataType, hash_t, equal_t> table_t;
+
+            /*
+             * partition_t: spilled runs of the keys of a partition
+             */
+            struct partition_t {
+                std::vector<size_t> runs; // runs in _store
+                size_t level;             // seed of the hash it was split by
+            };
+
+            // Aggregated records in memory
+            table_t _table;
+
+            // Bytes of _table accounted in _memory
+            size_t _bytes;
+
+            // Spill if bytes in memory of the job exceed the budget (0: no limit)
+            const size_t _memoryBudget;
+
+            // Bytes in memory of the job
+            memoryMetrics_t * _memory;
+
+            // Store of spilled partitions (its file is created by the first spill)
+            std::shared_ptr<SegmentStore> _store;
+
+            // Codec of spilled blocks
+            const uint32_t _codec;
+
+            // Compression metrics of spilled blocks
+            codecMetrics_t * _metrics;
+
+            // Runs spilled of each partition while records are added, empty till the first spill
+            std::vector<std::vector<size_t> > _spilled;
+
+            // Partitions left to aggregate when read
+            std::vector<partition_t> _pending;
+
+            // Lock of the table while records are added
+            std::mutex _lock;
+
+            // True once reading started, no record is added then
+            bool _reading;
+
+            // Next record of _table to read
+            typename table_t::const_iterator _cursor;
+
+            // Partition of a record by hash of key remixed with seed level (the hash also chose
+            // its machine, and the partitions it was split from at lower levels)
+            static size_t partitionOf(const DataType & v, size_t level);
+
+            // True if the table should be spilled for the memory budget
+            bool overBudget() const;
+
+            // Account a change of bytes of _table
+            void account(size_t before, size_t after);
+
+            // Fold a record into _table
+            void combine(const DataType & v);
+
+            // Spill _table to a run per partition of level, appended to parts, and empty it
+            bool spill(size_t level, std::vector<std::vector<size_t> > & parts);
+
+            // Empty _table
+            void clearTable();
+
+            // Aggregate the spilled runs of a partition into _table (split again into _pending if
+            // over the memory budget), the runs are removed
+            bool loadPartition(const partition_t & partition);
+
+        public:
+
+            // Constructor: spill to a store in dir
+            HashAggregator(const std::string & dir, const options_t & options,
+                           memoryMetrics_t * memory, codecMetrics_t * metrics = nullptr);
+
+            // Copy constructor (deleted)
+            HashAggregator(const HashAggregator<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            HashAggregator<DataType> & operator = (const HashAggregator<DataType> &) = delete;
+
+            // Destructor
+            ~HashAggregator();
+
+            // Add a record (thread safe), false if spilling fails or reading started
+            bool add(const DataType & v);
+
+            // Read an aggregated record, false if all are read (or spilled runs fail)
+            bool read(DataType & v);
+    };
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Partition of a record by hash of key remixed with seed level (the hash also chose
+    // its machine, and the partitions it was split from at lower levels)
+    template <typename DataType>
+    inline size_t HashAggregator<DataType>::partitionOf(const DataType & v, size_t level) {
+
+        uint64_t h = static_cast<uint64_t>(hash_t{}(v)) ^ (level * 0x9E3779B97F4A7C15ULL);
+
+        // Finalizer of MurmurHash3
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+
+        return static_cast<size_t>(h % HASH_SPILL_PARTITIONS);
+
+    }
+
+    // True if the table should be spilled for the memory budget
+    template <typename DataType>
+    inline bool HashAggregator<DataType>::overBudget() const {
+
+        // Small tables do not spill for the budget, as data managers do not
+        return (_memoryBudget != 0 && _memory->current > _memoryBudget &&
+                _bytes >= MIN_VAL(_memoryBudget, MIN_SPILL_SIZE));
+
+    }
+
+    // Account a change of bytes of _table
+    template <typename DataType>
+    inline void HashAggregator<DataType>::account(size_t before, size_t after) {
+
+        if (after > before) {
+            _memory->reserve(after - before);
+        } else if (after < before) {
+            _memory->release(before - after);
+        }
+
+        _bytes = _bytes + after - before;
+
+    }
+
+    // Fold a record into _table
+    template <typename DataType>
+    void HashAggregator<DataType>::combine(const DataType & v) {
+
+        auto it = _table.find(v);
+
+        if (it == _table.end()) {
+            it = _table.insert(v).first;
+            account(0, it->footprint() + HASH_ENTRY_OVERHEAD);
+            return;
+        }
+
+        // The key is kept, so the record stays in its place
+        DataType & into = const_cast<DataType &>(*it);
+        const size_t before = into.footprint();
+
+        recordCombine_t<DataType>::combine(into, v);
+        account(before, into.footprint());
+
+    }
+
+    // Spill _table to a run per partition of level, appended to parts, and empty it
+    template <typename DataType>
+    bool HashAggregator<DataType>::spill(size_t level, std::vector<std::vector<size_t> > & parts) {
+
+        if (_table.empty()) {
+            return true;
+        }
+
+        if (parts.empty()) {
+            parts.resize(HASH_SPILL_PARTITIONS);
+        }
+
+        std::vector<std::vector<const DataType *> > records(HASH_SPILL_PARTITIONS);
+
+        for (const DataType & v: _table) {
+            records[partitionOf(v, level)].push_back(&v);
+        }
+
+        BlockWriter<DataType> os{_codec, _metrics};
+        bool ret = true;
+
+        for (size_t p = 0; p < HASH_SPILL_PARTITIONS && ret; ++p) {
+            if (records[p].empty()) {
+                continue;
+            }
+
+            const size_t run = _store->createRun();
+            parts[p].push_back(run);
+
+            ret = os.open(_store, run);
+            for (size_t i = 0; i < records[p].size() && ret; ++i) {
+                ret = os.write(*(records[p][i]));
+            }
+            ret = os.close() && ret;
+        }
+
+        clearTable();
+
+        if (!ret) {
+            E("(HashAggregator) Fail to spill aggregated records.");
+        }
+
+        return ret;
+
+    }
+
+    // Empty _table
+    template <typename DataType>
+    void HashAggregator<DataType>::clearTable() {
+
+        _table.clear();
+        _memory->release(_bytes);
+        _bytes = 0;
+
+    }
+
+    // Aggregate the spilled runs of a partition into _table (split again into _pending if
+    // over the memory budget), the runs are removed
+    template <typename DataType>
+    bool HashAggregator<DataType>::loadPartition(const partition_t & partition) {
+
+        const size_t level = partition.level + 1;
+        std::vector<std::vector<size_t> > parts;
+        DataType v;
+        bool ret = true;
+
+        for (size_t run: partition.runs) {
+            // The run is removed when the reader is destroyed, even if it is not read
+            StoreRunReader<DataType> is{_store, run, _metrics};
+
+            while (ret && is.read(v)) {
+                combine(v);
+
+                // Keys of the partition do not fit, the rest is split again by another hash
+                // (keys with equal hash codes can not be split, they stay at the last level)
+                if (level <= HASH_MAX_LEVEL && overBudget()) {
+                    ret = spill(level, parts);
+                }
+            }
+        }
+
+        if (!parts.empty()) {
+            ret = ret && spill(level, parts);
+
+            for (std::vector<size_t> & runs: parts) {
+                if (!runs.empty()) {
+                    _pending.push_back(partition_t{std::move(runs), level});
+                }
+            }
+        }
+
+        return ret;
+
+    }
+
+    // Constructor: spill to a store in dir
+    template <typename DataType>
+    HashAggregator<DataType>::HashAggregator(const std::string & dir, const options_t & options,
+                                             memoryMetrics_t * memory, codecMetrics_t * metrics)
+    : _bytes{0}, _memoryBudget{options.memoryBudget}, _memory{memory},
+      _store{std::make_shared<SegmentStore>(dir)}, _codec{options.spillCodec},
+      _metrics{metrics}, _reading{false} {}
+
+    // Destructor
+    template <typename DataType>
+    HashAggregator<DataType>::~HashAggregator() {
+
+        clearTable();
+
+        for (const std::vector<size_t> & runs: _spilled) {
+            for (size_t run: runs) {
+                _store->removeRun(run);
+            }
+        }
+
+        for (const partition_t & partition: _pending) {
+            for (size_t run: partition.runs) {
+                _store->removeRun(run);
+            }
+        }
+
+    }
+
+    // Add a record (thread safe), false if spilling fails or reading started
+    template <typename DataType>
+    bool HashAggregator<DataType>::add(const DataType & v) {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        // The table may be iterated by read
+        if (_reading) {
+            E("(HashAggregator) Record added after reading started.");
+            return false;
+        }
+
+        combine(v);
+
+        if (overBudget()) {
+            return spill(0, _spilled);
+        }
+
+        return true;
+
+    }
+
+    // Read an aggregated record, false if all are read (or spilled runs fail)
+    template <typename DataType>
+    bool HashAggregator<DataType>::read(DataType & v) {
+
+        if (!_reading) {
+            std::lock_guard<std::mutex> holder{_lock};
+
+            _reading = true;
+
+            // Once spilled, the rest is spilled too so that each partition is read whole
+            if (!_spilled.empty()) {
+                if (!spill(0, _spilled)) {
+                    return false;
+                }
+
+                for (std::vector<size_t> & runs: _spilled) {
+                    if (!runs.empty()) {
+                        _pending.push_back(partition_t{std::move(runs), 0});
+                    }
+                }
+                _spilled.clear();
+            }
+
+            _cursor = _table.begin();
+        }
+
+        while (_cursor == _table.end()) {
+            clearTable();
+
+            if (_pending.empty()) {
+                return false;
+            }
+
+            const partition_t partition = std::move(_pending.back());
+            _pending.pop_back();
+
+            if (!loadPartition(partition)) {
+                return false;
+            }
+
+            _cursor = _table.begin();
+        }
+
+        v = *_cursor;
+        ++_cursor;
+
+        return true;
+
+    }
+}
+
+#endif
@@ -5,14 +5,25 @@
 #ifndef JOB_H
 #define JOB_H
 
-#include <string> // string
+#include <sys/stat.h> // stat
+#include <stdio.h> // snprintf
+
+#include <string> // string, to_string
 #include <vector> // vector
 #include <memory> // unique_ptr
 #include <thread> // thread
+#include <algorithm> // sort
 
 #include "def.hpp" // ipconfig_t
 #include "sourceManager.hpp" // SourceManager
 #include "streamManager.hpp" // StreamManager
+#include "groupIterator.hpp" // GroupIterator
+#include "recordOrder.hpp" // recordCombine_t
+#include "partitioner.hpp" // RangePartitioner, VirtualPartitioner, HotKeys, hashPartitioner
+#include "options.hpp" // options_t
+#include "metrics.hpp" // Metrics
+#include "shuffleMesh.hpp" // ShuffleMesh
+#include "utils.hpp" // Mkdir
 
 namespace ch {
 
@@ -27,6 +38,8 @@ namespace ch {
         const std::string & _jobName;
         const bool _isServer;
         const bool _supportMultipleMapper;
+        ch::ShuffleMesh * const _mesh; // persistent connections of the server (nullable)
+        std::string _manifest; // set by the job: "<id> <ip> <path> <records> <bytes>" per output file
 
         explicit context_t(const ipconfig_t & ips,
                            ch::SourceManager & source,
@@ -34,15 +47,77 @@ namespace ch {
                            const std::string & workingDir,
                            const std::string & jobName,
                            const bool isServer = false,
-                           const bool supportMultipleMapper = false)
+                           const bool supportMultipleMapper = false,
+                           ch::ShuffleMesh * mesh = nullptr)
         : _ips(ips), _source(source), _outputFilePath(outputFilePath),
           _workingDir(workingDir), _jobName(jobName), _isServer(isServer),
-          _supportMultipleMapper(supportMultipleMapper) {}
+          _supportMultipleMapper(supportMultipleMapper), _mesh(mesh) {}
     };
 
     // Job function type
     typedef bool job_f(context_t & context);
 
+    /*
+     * Print metrics of the job on this machine
+     */
+    inline void reportMetrics(const context_t & context, const Metrics & metrics) {
+
+        const std::string summary = metrics.toString();
+
+        if (!summary.empty()) {
+            PSS("(Job) " << context._jobName << " metrics: " << summary);
+        }
+
+    }
+
+    /*
+     * Write reducer output of this machine and record it in the manifest of the context
+     * OUTPUT_SINGLE: master writes the output file
+     * OUTPUT_PARTS: every machine writes part-<id> in the output directory
+     */
+    template <typename DataType>
+    bool writeOutput(context_t & context, StreamManager<DataType> & stm, const options_t & options) {
+
+        const size_t id = context._ips[0].first;
+        std::string path;
+
+        if (options.outputMode == OUTPUT_PARTS) {
+            path = context._outputFilePath;
+
+            if (!Mkdir(path)) {
+                E("(Job) Cannot create output directory.");
+                return false;
+            }
+
+            char name[32];
+            snprintf(name, sizeof(name), PART_FILE_PREFIX "%05zu", id);
+            path += name;
+        } else if (context._isServer) {
+            path = context._outputFilePath;
+        } else {
+            return true;
+        }
+
+        size_t records = 0;
+
+        const bool written = options.binaryOutput
+                             ? stm.pourToRecordFile(path.c_str(), &records, options.outputCodec)
+                             : stm.pourToTextFile(path.c_str(), &records, options.textFormat);
+
+        if (!written) {
+            return false;
+        }
+
+        struct stat st;
+        size_t bytes = (stat(path.c_str(), &st) == 0) ? st.st_size : 0;
+
+        context._manifest = std::to_string(id) + " " + context._ips[0].second + " " + path + " " +
+                            std::to_string(records) + " " + std::to_string(bytes) + "\n";
+
+        return true;
+
+    }
+
     /*
      * Default mapper definition
      */
@@ -66,28 +141,11 @@ namespace ch {
     }
 
     /*
-     * Simple job:
-     * output type of mapper and reducer are the same so that we can reuse stream manager
+     * Run mapper on data polled from source
      */
-    template <typename MapperReducerOutputType>
-    bool simpleJob(context_t & context) {
-
-        StreamManager<MapperReducerOutputType> stm{context._ips, context._workingDir,
-                                                   context._jobName, DEFAULT_MAX_DATA_SIZE};
-
-        if (!stm.isConnected()) { // Not connected
-            E("(Job) StreamManager connect failed. Nothing done.");
-            return false;
-        }
-
-        stm.startReceive();
-
-        if (!stm.isReceiving()) { // Fail to start receive threads
-            E("(Job) StreamManager start receive threads failed. Nothing done.");
-            return false;
-        }
+    template <typename MapperOutputType>
+    void runMappers(context_t & context, StreamManager<MapperOutputType> & stm) {
 
-        // Map
 #ifndef MULTIPLE_MAPPER
         std::string polled;
         while (context._source.poll(polled)) {
@@ -119,12 +177,369 @@ namespace ch {
             }
         }
 #endif
-        stm.stopSend();
+
+    }
+
+    /*
+     * True if records can be reduced as options ask: REDUCE_HASH needs the job to specialize
+     * recordCombine_t of the reduced records
+     */
+    template <typename DataType>
+    inline bool checkReduceMode(const options_t & options) {
+
+        if (options.reduceMode == REDUCE_HASH && !recordCombine_t<DataType>::defined) {
+            E("(Job) REDUCE_HASH needs recordCombine_t of the reduced records. Nothing done.");
+            return false;
+        }
+
+        return true;
+
+    }
+
+    /*
+     * Number of buckets of map output on each machine, reduced in parallel
+     * (one if output of a machine must keep the order of keys)
+     */
+    inline size_t reduceBuckets(const options_t & options) {
+
+        return (options.partitionMode == PARTITION_RANGE) ? 1 : options.reduceThreads;
+
+    }
+
+    /*
+     * Run reducer on sorted streams, one thread per stream
+     */
+    template <typename ReducerInputType, typename ReducerOutputType>
+    void runReducers(std::vector<std::unique_ptr<SortedStream<ReducerInputType> > > & sorteds,
+                     StreamManager<ReducerOutputType> & stm) {
+
+        if (sorteds.size() == 1) {
+            reducer(*(sorteds[0]), stm);
+            return;
+        }
+
+        std::vector<std::thread> reducers;
+
+        for (std::unique_ptr<SortedStream<ReducerInputType> > & sorted: sorteds) {
+            SortedStream<ReducerInputType> * ss = sorted.get();
+
+            reducers.emplace_back([ss, &stm](){
+                reducer(*ss, stm);
+            });
+        }
+        for (std::thread & thrd: reducers) {
+            thrd.join();
+        }
+
+    }
+
+    /*
+     * Send samples of this machine to all machines,
+     * samples are replaced by the sorted samples of all machines (same on all machines)
+     */
+    template <typename DataType>
+    bool exchangeSamples(context_t & context, std::vector<DataType> & samples,
+                         const std::string & suffix, const options_t & options, Metrics & metrics) {
+
+        StreamManager<DataType> exchange{context._ips, context._workingDir,
+                                         context._jobName + suffix, options, &metrics,
+                                         true, hashPartitioner, context._mesh};
+
+        if (!exchange.isConnected()) {
+            E("(Job) StreamManager of samples connect failed.");
+            return false;
+        }
+
+        exchange.startReceive();
+
+        if (!exchange.isReceiving()) {
+            E("(Job) StreamManager of samples start receive threads failed.");
+            return false;
+        }
+
+        for (DataType & v: samples) {
+            exchange.pushAll(v);
+        }
+        const bool sent = exchange.finalizeSend();
+        exchange.blockTillRecvEnd();
+
+        if (!sent) {
+            E("(Job) Fail to deliver samples to other machines.");
+            return false;
+        }
+
+        samples.clear();
+
+        SortedStream<DataType> * sorted = exchange.getSortedStream();
+
+        if (sorted) {
+            std::unique_ptr<SortedStream<DataType> > _sorted{sorted};
+
+            DataType temp;
+            while (sorted->get(temp)) {
+                samples.push_back(temp);
+            }
+        }
+
+        return true;
+
+    }
+
+    /*
+     * Partition map output by a sample of all machines:
+     * map to local data while sampling it, exchange samples so that all machines choose the same
+     * key ranges (PARTITION_RANGE) or the same table of virtual partitions balanced by their load
+     * in samples, then push local data to stm
+     */
+    template <typename MapperOutputType>
+    bool shuffleBySample(context_t & context, StreamManager<MapperOutputType> & stm,
+                         VirtualPartitioner & partitions, const options_t & options,
+                         Metrics & metrics) {
+
+        const ipconfig_t self{context._ips[0]};
+
+        StreamManager<MapperOutputType> local{self, context._workingDir,
+                                              context._jobName + "#local", options, &metrics,
+                                              false};
+
+        local.setLocalOutput(true);
+        local.setSampling(options.rangeSamples);
+        runMappers(context, local);
+
+        std::vector<MapperOutputType> samples;
+        local.getSamples(samples);
+
+        if (!exchangeSamples(context, samples, "#sample", options, metrics)) {
+            return false;
+        }
+
+        RangePartitioner<MapperOutputType> range;
+
+        if (options.partitionMode == PARTITION_RANGE) {
+            range.setSplits(samples, context._ips.size());
+            stm.setPartitioner(range);
+        } else {
+            std::vector<size_t> loads(partitions.partitions(), 0);
+
+            for (MapperOutputType & v: samples) {
+                ++loads[partitions.getVirtualPartition(v.hashCode())];
+            }
+            partitions.balance(context._ips.size(), loads, options.partitionWeights);
+            stm.setPartitioner(partitions);
+        }
+
+        UnsortedStream<MapperOutputType> * unsorted = local.getUnsortedStream();
+        bool ret = true;
+
+        if (unsorted) {
+            std::unique_ptr<UnsortedStream<MapperOutputType> > _unsorted{unsorted};
+
+            MapperOutputType temp;
+            while (unsorted->get(temp)) {
+                if (!stm.push(temp)) {
+                    ret = false;
+                    break;
+                }
+            }
+        }
+
+        if (options.partitionMode == PARTITION_RANGE) {
+            stm.setPartitioner(hashPartitioner);
+        }
+
+        return ret;
+
+    }
+
+    /*
+     * Map with salting of hot keys:
+     * map the first skewSamples records while sampling them, exchange keys frequent in
+     * samples between all machines so that all of them know the same hot keys, then map the rest
+     * with records of hot keys spread over all machines
+     */
+    template <typename MapperOutputType>
+    bool runMappersSalted(context_t & context, StreamManager<MapperOutputType> & stm,
+                          HotKeys<MapperOutputType> & hotKeys, const options_t & options,
+                          Metrics & metrics) {
+
+        stm.setSampling(options.skewSamples);
+
+        std::string polled;
+        while (stm.sampledRecords() < options.skewSamples && context._source.poll(polled)) {
+            mapper(polled, stm);
+        }
+
+        std::vector<MapperOutputType> samples;
+        stm.getSamples(samples);
+        std::sort(samples.begin(), samples.end());
+
+        // Keys frequent in samples of this machine
+        const size_t threshold = MAX_VAL(2, static_cast<size_t>(options.hotKeyShare *
+                                                                options.skewSamples));
+        std::vector<MapperOutputType> candidates;
+
+        for (size_t i = 0, l = samples.size(); i < l;) {
+            size_t j = i + 1;
+
+            while (j < l && samples[j] == samples[i]) {
+                ++j;
+            }
+            if (j - i >= threshold) {
+                candidates.push_back(samples[i]);
+            }
+            i = j;
+        }
+
+        if (!exchangeSamples(context, candidates, "#skew", options, metrics)) {
+            return false;
+        }
+
+        hotKeys.setKeys(std::move(candidates));
+        metrics.skew.hotKeys = hotKeys.size();
+
+        if (hotKeys.size() > 0) {
+            stm.setHotKeys(&hotKeys);
+        }
+        runMappers(context, stm);
+        stm.setHotKeys(nullptr);
+
+        return true;
+
+    }
+
+    /*
+     * Map phase: partition map output as chosen by options
+     * hot keys are salted only if hotKeys is not nullptr
+     */
+    template <typename MapperOutputType>
+    bool runMapPhase(context_t & context, StreamManager<MapperOutputType> & stm,
+                     VirtualPartitioner & partitions, HotKeys<MapperOutputType> * hotKeys,
+                     const options_t & options, Metrics & metrics) {
+
+        if (partitions.partitions() > 0) {
+            partitions.assignByWeight(context._ips.size(), options.partitionWeights);
+            stm.setPartitioner(partitions);
+        }
+
+        if (options.partitionMode == PARTITION_RANGE ||
+            (partitions.partitions() > 0 && options.balancePartitions)) {
+            if (!shuffleBySample(context, stm, partitions, options, metrics)) {
+                E("(Job) Fail to partition map output by samples.");
+                return false;
+            }
+        } else if (hotKeys != nullptr && options.skewMitigation) {
+            if (!runMappersSalted(context, stm, *hotKeys, options, metrics)) {
+                E("(Job) Fail to find hot keys.");
+                return false;
+            }
+        } else {
+            runMappers(context, stm);
+        }
+
+        return true;
+
+    }
+
+    /*
+     * Reduce with hot keys salted in map:
+     * partial results of hot keys are sent to the machine owning the key and reduced again there
+     */
+    template <typename DataType>
+    bool reduceAndCombine(context_t & context, StreamManager<DataType> & stm,
+                          std::vector<std::unique_ptr<SortedStream<DataType> > > & sorteds,
+                          const HotKeys<DataType> & hotKeys, const options_t & options,
+                          Metrics & metrics) {
+
+        StreamManager<DataType> combiner{context._ips, context._workingDir,
+                                         context._jobName + "#combine", options, &metrics,
+                                         true, hashPartitioner, context._mesh};
+
+        if (!combiner.isConnected()) {
+            E("(Job) StreamManager of partial results connect failed.");
+            return false;
+        }
+
+        combiner.startReceive();
+
+        if (!combiner.isReceiving()) {
+            E("(Job) StreamManager of partial results start receive threads failed.");
+            return false;
+        }
+
+        stm.setHotKeys(&hotKeys, &combiner);
+        runReducers(sorteds, stm);
+        stm.setHotKeys(nullptr);
+
+        const bool sent = combiner.finalizeSend();
+        combiner.blockTillRecvEnd();
+
+        if (!sent) {
+            E("(Job) Fail to deliver partial results of hot keys.");
+            return false;
+        }
+
+        SortedStream<DataType> * partial = combiner.getSortedStream();
+
+        if (partial) {
+            std::unique_ptr<SortedStream<DataType> > _partial{partial};
+            reducer(*partial, stm);
+        }
+
+        return true;
+
+    }
+
+    /*
+     * Simple job:
+     * output type of mapper and reducer are the same so that we can reuse stream manager
+     */
+    template <typename MapperReducerOutputType>
+    bool simpleJob(context_t & context, const options_t & options = options_t()) {
+
+        if (!checkReduceMode<MapperReducerOutputType>(options)) {
+            return false;
+        }
+
+        Metrics metrics;
+
+        StreamManager<MapperReducerOutputType> stm{context._ips, context._workingDir,
+                                                   context._jobName, options, &metrics,
+                                                   true, hashPartitioner, context._mesh};
+
+        if (!stm.isConnected()) { // Not connected
+            E("(Job) StreamManager connect failed. Nothing done.");
+            return false;
+        }
+
+        stm.setBuckets(reduceBuckets(options));
+        stm.setAggregate(options.reduceMode == REDUCE_HASH);
+        stm.startReceive();
+
+        if (!stm.isReceiving()) { // Fail to start receive threads
+            E("(Job) StreamManager start receive threads failed. Nothing done.");
+            return false;
+        }
+
+        VirtualPartitioner partitions{options.virtualPartitions};
+        HotKeys<MapperReducerOutputType> hotKeys;
+
+        // Map
+        if (!runMapPhase(context, stm, partitions, &hotKeys, options, metrics)) {
+            return false;
+        }
+        const bool mapSent = stm.stopSend();
         stm.blockTillRecvEnd();
         // End of map
 
-        SortedStream<MapperReducerOutputType> * sorted = stm.getSortedStream();
-        std::unique_ptr<SortedStream<MapperReducerOutputType> > _sorted{sorted};
+        if (!mapSent) {
+            E("(Job) Fail to deliver map output to other machines.");
+            return false;
+        }
+
+        metrics.skew.reduceRecords = stm.storedRecords();
+
+        std::vector<std::unique_ptr<SortedStream<MapperReducerOutputType> > > sorteds;
+        stm.getSortedStreams(sorteds);
 
         stm.setPresort(false);
         stm.startReceive();
@@ -136,19 +551,33 @@ namespace ch {
         }
 
         // Reduce
-        if (sorted) {
+        if (options.outputMode == OUTPUT_PARTS) {
+            stm.setLocalOutput(true);
+        } else {
             stm.setPartitioner(zeroPartitioner);
-            reducer(*sorted, stm);
         }
-        stm.finalizeSend();
+        if (hotKeys.size() > 0) {
+            if (!reduceAndCombine(context, stm, sorteds, hotKeys, options, metrics)) {
+                E("(Job) Fail to combine partial results of hot keys.");
+                return false;
+            }
+        } else {
+            runReducers(sorteds, stm);
+        }
+        const bool reduceSent = stm.finalizeSend();
         stm.blockTillRecvEnd();
         // End of reduce
 
-        if (context._isServer) {
-            return stm.pourToTextFile(context._outputFilePath.c_str());
+        if (!reduceSent) {
+            E("(Job) Fail to deliver reduce output.");
+            return false;
         }
 
-        return true;
+        bool ret = writeOutput(context, stm, options);
+
+        reportMetrics(context, metrics);
+
+        return ret;
 
     }
 
@@ -157,16 +586,25 @@ namespace ch {
      * output type of mapper and reducer are different
      */
     template <typename MapperOutputType, typename ReducerOutputType>
-    bool completeJob(context_t & context) {
+    bool completeJob(context_t & context, const options_t & options = options_t()) {
+
+        if (!checkReduceMode<MapperOutputType>(options)) {
+            return false;
+        }
+
+        Metrics metrics;
 
         StreamManager<MapperOutputType> stm_mapper{context._ips, context._workingDir,
-                                                   context._jobName, DEFAULT_MAX_DATA_SIZE};
+                                                   context._jobName, options, &metrics,
+                                                   true, hashPartitioner, context._mesh};
 
         if (!stm_mapper.isConnected()) { // Not connected
             E("(Job) StreamManager connect failed. Nothing done.");
             return false;
         }
 
+        stm_mapper.setBuckets(reduceBuckets(options));
+        stm_mapper.setAggregate(options.reduceMode == REDUCE_HASH);
         stm_mapper.startReceive();
 
         if (!stm_mapper.isReceiving()) { // Fail to start receive threads
@@ -174,47 +612,33 @@ namespace ch {
             return false;
         }
 
+        VirtualPartitioner partitions{options.virtualPartitions};
+
         // Map
-#ifndef MULTIPLE_MAPPER
-        std::string polled;
-        while (context._source.poll(polled)) {
-            mapper(polled, stm_mapper);
+        HotKeys<MapperOutputType> * noHotKeys = nullptr; // reducer output differs, cannot combine
+        if (!runMapPhase(context, stm_mapper, partitions, noHotKeys, options, metrics)) {
+            return false;
         }
-#else
-        if (context._supportMultipleMapper) {
-            std::vector<std::thread> mappers;
-            std::vector<std::string> polleds(NUM_MAPPER);
-            SourceManager & source = context._source;
+        const bool mapSent = stm_mapper.finalizeSend();
+        stm_mapper.blockTillRecvEnd();
+        // End of map
 
-            for (size_t i = 0; i < NUM_MAPPER; ++i) {
-                std::string & polled = polleds[i];
+        if (!mapSent) {
+            E("(Job) Fail to deliver map output to other machines.");
+            return false;
+        }
 
-                mappers.emplace_back([&source, &polled, &stm_mapper](){
-                    while (source.poll(polled)) {
-                        mapper(polled, stm_mapper);
-                    }
-                });
-            }
-            for (std::thread & thrd: mappers) {
-                thrd.join();
-            }
-        } else {
-            std::string polled;
+        metrics.skew.reduceRecords = stm_mapper.storedRecords();
 
-            while (context._source.poll(polled)) {
-                mapper(polled, stm_mapper);
-            }
-        }
-#endif
-        stm_mapper.finalizeSend();
-        stm_mapper.blockTillRecvEnd();
-        // End of map
+        std::vector<std::unique_ptr<SortedStream<MapperOutputType> > > sorteds;
+        stm_mapper.getSortedStreams(sorteds);
 
-        SortedStream<MapperOutputType> * sorted = stm_mapper.getSortedStream();
-        std::unique_ptr<SortedStream<MapperOutputType> > _sorted{sorted};
+        // Channels of reduce phase are distinct from those of map phase
+        const std::string reduceName = context._jobName + "#reduce";
 
         StreamManager<ReducerOutputType> stm_reducer{context._ips, context._workingDir,
-                                                context._jobName, DEFAULT_MAX_DATA_SIZE, false};
+                                                reduceName, options, &metrics, false,
+                                                hashPartitioner, context._mesh};
 
         if (!stm_reducer.isConnected()) { // Not connected
             E("(Job) StreamManager connect failed. Fail to perform reduce on this machine.");
@@ -230,19 +654,26 @@ namespace ch {
         }
 
         // Reduce
-        if (sorted) {
+        if (options.outputMode == OUTPUT_PARTS) {
+            stm_reducer.setLocalOutput(true);
+        } else {
             stm_reducer.setPartitioner(zeroPartitioner);
-            reducer(*sorted, stm_reducer);
         }
-        stm_reducer.finalizeSend();
+        runReducers(sorteds, stm_reducer);
+        const bool reduceSent = stm_reducer.finalizeSend();
         stm_reducer.blockTillRecvEnd();
         // End of reduce
 
-        if (context._isServer) {
-            return stm_reducer.pourToTextFile(context._outputFilePath.c_str());
+        if (!reduceSent) {
+            E("(Job) Fail to deliver reduce output.");
+            return false;
         }
 
-        return true;
+        bool ret = writeOutput(context, stm_reducer, options);
+
+        reportMetrics(context, metrics);
+
+        return ret;
 
     }
 }
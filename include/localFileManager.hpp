@@ -1,20 +1,32 @@
 /*
- * Manager temporary files in local machine
+ * Manager temporary runs in local machine, kept in one segment store
  */
 
 #ifndef LOCALFILEMANAGER_H
 #define LOCALFILEMANAGER_H
 
-#include <unistd.h>           // unlink
+#include <stdint.h>           // uint64_t
 
 #include <vector>             // vector
 #include <string>             // string
-#include <fstream>            // ofstream
-
-#include "def.hpp"            // RANDOM_FILE_NAME_LENGTH
+#include <mutex>              // mutex, lock_guard
+#include <memory>             // shared_ptr, make_shared
+#include <unordered_map>      // unordered_map
+#include <queue>              // priority_queue
+#include <future>             // future
+#include <thread>             // thread
+#include <functional>         // greater
+
+#include "def.hpp"            // MIN/MAX_MERGE_WAY, MERGE_RUN_MEMORY, DEFAULT_MEMORY_BUDGET,
+                              // CODEC_NONE
+#include "segmentStore.hpp"   // SegmentStore
+#include "threadPool.hpp"     // ThreadPool
 #include "sortedStream.hpp"   // SortedStream
 #include "unsortedStream.hpp" // UnsortedStream
-#include "utils.hpp"          // randomString
+#include "blockStream.hpp"    // BlockWriter
+#include "recordArena.hpp"    // RecordArena
+#include "runReader.hpp"      // RunReader, StoreRunReader
+#include "metrics.hpp"        // codecMetrics_t
 
 namespace ch {
 
@@ -22,36 +34,74 @@ namespace ch {
      ************** Declaration *****************
     ********************************************/
 
-    typedef std::vector<std::string>::reverse_iterator FileIterR;
+    /*
+     * mergeStep_t: a planned merge, inputs are nodes of the plan (dump runs first, then the
+     * outputs of the steps in order)
+     */
+    struct mergeStep_t {
+        std::vector<size_t> inputs; // nodes merged
+        bool done;                  // true once it ran (its output is written if it succeeded)
+    };
 
     template <typename DataType>
     class LocalFileManager {
 
         protected:
 
-            // Directory of dump file
+            // Directory of the store file
             const std::string dumpFileDir;
 
-            // All dump files it holds
-            std::vector<std::string> dumpFiles;
+            // Threads running independent merges
+            const size_t _mergeThreads;
+
+            // Store of all dump runs, one preallocated file (an I/O thread per merge thread)
+            std::shared_ptr<SegmentStore> _store;
+
+            // All dump runs it holds
+            std::vector<size_t> dumpRuns;
+
+            // Codec of dump runs
+            uint32_t _codec;
+
+            // Compression metrics
+            codecMetrics_t * _metrics;
+
+            // Most runs merged at once, from the memory budget left to each merge thread
+            const size_t _mergeWay;
+
+            // Lock of dumpRuns, runs may be merged in background
+            std::mutex _runsLock;
+
+            // Number of background merges that produced a run (absent: dumped run)
+            std::unordered_map<size_t, size_t> _levels;
+
+            // Lowest level with at least way runs, false if there is none
+            bool findTier(size_t way, size_t & level);
 
-            // Sort data if there are no greater than MERGE_SORT_WAY files
-            bool unitMergeSort(const FileIterR & begin, const FileIterR & end);
+            // Create a new run and open output block stream on it
+            bool createRun(BlockWriter<DataType> & os, size_t & run);
 
-            // Sort data if there are less than MERGE_SORT_WAY * MERGE_SORT_WAY files
-            // and greater than MERGE_SORT_WAY files
-            bool gridMergeSort (const FileIterR & begin, const FileIterR & end);
+            // Reader of a dump run, the run is removed when it is destroyed
+            RunReader<DataType> * runReader(size_t run);
 
-            // Sort data if there are no less than MERGE_SORT_WAY * MERGE_SORT_WAY files
-            bool fullMergeSort (const FileIterR & begin, const FileIterR & end);
+            // Merge runs into a new run (inputs are removed)
+            bool mergeRuns(const std::vector<size_t> & inputs, size_t & merged);
 
-            // Entry that actually do merge sort
+            // Plan merges leaving at most _mergeWay runs for the final merge, smallest runs
+            // first with the first merge sized so that the others are full (fewest bytes
+            // rewritten, as a Huffman tree of fan-in _mergeWay)
+            void planMerges(const std::vector<size_t> & runs, std::vector<mergeStep_t> & steps,
+                            std::vector<size_t> & remain);
+
+            // Merge dump runs till at most _mergeWay remain, independent merges in parallel
             bool doMergeSort ();
 
         public:
 
             // Constructor
-            LocalFileManager(const std::string & dir);
+            LocalFileManager(const std::string & dir, uint32_t codec = CODEC_NONE,
+                             codecMetrics_t * metrics = nullptr,
+                             size_t memoryBudget = DEFAULT_MEMORY_BUDGET, size_t mergeThreads = 1);
 
             // Copy constructor (deleted)
             LocalFileManager(const LocalFileManager<DataType> & fileManager) = delete;
@@ -62,149 +112,228 @@ namespace ch {
             // Copy assignment (deleted)
             LocalFileManager<DataType> & operator = (const LocalFileManager<DataType> &) = delete;
 
-            // Move assignment
-            LocalFileManager<DataType> & operator = (LocalFileManager<DataType> && o);
+            // Move assignment (deleted)
+            LocalFileManager<DataType> & operator = (LocalFileManager<DataType> &&) = delete;
 
             // Destructor
             ~LocalFileManager();
 
-            // Remove all temporary files
+            // Remove all temporary runs
             void clear();
 
-            // Get output file stream of a new temporary file
-            bool getStream(std::ofstream & os);
+            // Get output block stream of a new temporary run
+            bool getStream(BlockWriter<DataType> & os);
+
+            // Most runs merged at once
+            size_t mergeWay() const;
+
+            // True if way runs of the same level can be merged
+            bool hasFullTier(size_t way);
 
-            // Dump data to file
+            // Merge way runs of the lowest level with at least way runs into one
+            // (size tiered, each record is rewritten once per level), false if merge failed
+            bool mergeTier(size_t way);
+
+            // Dump data to a run
             bool dumpToFile(std::vector<const DataType *> & data);
 
-            // Get sorted stream with all files
-            SortedStream<DataType> * getSortedStream();
+            // Dump records of arena to a run in order of its index, arena is cleared
+            bool dumpToFile(RecordArena<DataType> & arena);
+
+            // Get sorted stream with all dump runs and sorted runs (owned by the stream)
+            SortedStream<DataType> * getSortedStream(
+                const std::vector<RunReader<DataType> *> & runs = std::vector<RunReader<DataType> *>());
 
-            // Get unsorted stream with all files
-            UnsortedStream<DataType> * getUnsortedStream();
+            // Get unsorted stream with all dump runs and runs (owned by the stream)
+            UnsortedStream<DataType> * getUnsortedStream(
+                const std::vector<RunReader<DataType> *> & runs = std::vector<RunReader<DataType> *>());
     };
 
     /********************************************
      ************ Implementation ****************
     ********************************************/
 
-    // Sort data if there are no greater than MERGE_SORT_WAY files
+    // Reader of a dump run, the run is removed when it is destroyed
     template <typename DataType>
-    bool LocalFileManager<DataType>::unitMergeSort(const FileIterR & begin,
-                                                   const FileIterR & end) {
+    inline RunReader<DataType> * LocalFileManager<DataType>::runReader(size_t run) {
 
-        SortedStream<DataType> stm{begin, end};
-        std::ofstream os;
+        return new StoreRunReader<DataType>{_store, run, _metrics};
 
-        if (!getStream(os)) {
-            return false;
-        }
+    }
 
-        DataType temp;
+    // Merge runs into a new run (inputs are removed)
+    template <typename DataType>
+    bool LocalFileManager<DataType>::mergeRuns(const std::vector<size_t> & inputs,
+                                               size_t & merged) {
 
-        while (stm.get(temp)) {
-            if (!(os << temp) || !os) {
-                E("(LocalFileManager) Cannot write to file while merge sort.");
-                I("Check if there is no space.");
-                return false;
+        BlockWriter<DataType> os{_codec, _metrics};
+
+        if (!createRun(os, merged)) {
+            for (size_t run: inputs) {
+                _store->removeRun(run);
             }
+            return false;
         }
 
-        return true;
+        bool written = true;
 
-    }
+        {
+            // Inputs are removed when the stream is destroyed
+            SortedStream<DataType> stm;
+            DataType temp;
 
-    // Sort data if there are less than MERGE_SORT_WAY * MERGE_SORT_WAY files
-    // and greater than MERGE_SORT_WAY files
-    template <typename DataType>
-    bool LocalFileManager<DataType>::gridMergeSort (const FileIterR & begin,
-                                                    const FileIterR & end) {
-
-        const int l = end - begin - MERGE_SORT_WAY; // reserve for all slot
-        const int fullSlots = l / (MERGE_SORT_WAY - 1); // number of full merges
-        const int remain = l % (MERGE_SORT_WAY - 1) + 1; // number of files to merge
-        FileIterR it = begin;
-        FileIterR next_it;
-
-        // Step 1: MERGE_SORT_WAY full merge
-        for (int i = 0; i < fullSlots; i++) {
-            next_it = it + MERGE_SORT_WAY;
-            if (!unitMergeSort(it, next_it)) {
-                return false;
+            for (size_t run: inputs) {
+                stm.addRun(runReader(run));
             }
-            it = next_it;
-        }
 
-        // Step 2: less than MERGE_SORT_WAY merge
-        if (remain > 0) {
-            next_it = it + remain;
-            if (unitMergeSort(it, next_it)) {
-                return false;
+            while (written && stm.get(temp)) {
+                written = os.write(temp);
             }
-            it = next_it;
         }
 
-        // Step 3: single files without a need to merge
-        while (it < end) {
-            dumpFiles.push_back(*it);
-            ++it;
+        if (!os.close() || !written) {
+            _store->removeRun(merged);
+            E("(LocalFileManager) Cannot write to run while merge sort.");
+            I("Check if there is no space.");
+            return false;
         }
 
         return true;
 
     }
 
-    // Sort data if there are no less than MERGE_SORT_WAY * MERGE_SORT_WAY files
+    // Plan merges leaving at most _mergeWay runs for the final merge, smallest runs
+    // first with the first merge sized so that the others are full (fewest bytes
+    // rewritten, as a Huffman tree of fan-in _mergeWay)
     template <typename DataType>
-    bool LocalFileManager<DataType>::fullMergeSort (const FileIterR & begin,
-                                                    const FileIterR & end) {
+    void LocalFileManager<DataType>::planMerges(const std::vector<size_t> & runs,
+                                                std::vector<mergeStep_t> & steps,
+                                                std::vector<size_t> & remain) {
 
-        FileIterR it = end;
-        FileIterR next_it = end - MERGE_SORT_WAY;
+        typedef std::pair<uint64_t, size_t> node_t; // bytes, node
 
-        while (next_it > begin) {
-            // loop invariant: index increase -> size decrease
-            if (!unitMergeSort(next_it, it)) {
-                return false;
+        std::priority_queue<node_t, std::vector<node_t>, std::greater<node_t> > heap;
+
+        for (size_t i = 0; i < runs.size(); ++i) {
+            heap.push(node_t{_store->runSize(runs[i]), i});
+        }
+
+        size_t way = (heap.size() - 2) % (_mergeWay - 1) + 2;
+
+        while (heap.size() > _mergeWay) {
+            mergeStep_t step;
+            uint64_t bytes = 0;
+
+            step.done = false;
+            for (size_t i = 0; i < way; ++i) {
+                bytes += heap.top().first;
+                step.inputs.push_back(heap.top().second);
+                heap.pop();
             }
 
-            it = next_it;
-            next_it = it - MERGE_SORT_WAY;
+            heap.push(node_t{bytes, runs.size() + steps.size()});
+            steps.push_back(std::move(step));
+            way = _mergeWay;
         }
 
-        return unitMergeSort(begin, it);
+        for (; !heap.empty(); heap.pop()) {
+            remain.push_back(heap.top().second);
+        }
 
     }
 
-    // Entry that actually do merge sort
+    // Merge dump runs till at most _mergeWay remain, independent merges in parallel
     template <typename DataType>
     bool LocalFileManager<DataType>::doMergeSort () {
 
-        size_t l = dumpFiles.size();
+        if (dumpRuns.size() <= _mergeWay) {
+            return true;
+        }
 
-        // full merge sort first
-        while (l >= MERGE_SORT_WAY * MERGE_SORT_WAY) {
-            // loop invariant: index increase -> size decrease
-            std::vector<std::string> files{std::move(dumpFiles)};
-            dumpFiles.clear(); // dumpFiles unspecified, clear dumpFiles
+        std::vector<size_t> runs{std::move(dumpRuns)};
+        std::vector<mergeStep_t> steps;
+        std::vector<size_t> remain;
 
-            if (!fullMergeSort(files.rbegin(), files.rend())) {
-                return false;
+        dumpRuns.clear(); // dumpRuns unspecified, clear dumpRuns
+        planMerges(runs, steps, remain);
+
+        // Run of each node, ready if a dump run or the output of a done step
+        std::vector<size_t> nodes{runs};
+        nodes.resize(runs.size() + steps.size());
+
+        std::unique_ptr<ThreadPool> pool;
+        if (_mergeThreads > 1) {
+            pool.reset(new ThreadPool{_mergeThreads});
+        }
+
+        bool ret = true;
+
+        // Each round runs the steps whose inputs are all ready
+        for (size_t left = steps.size(); ret && left > 0;) {
+            std::vector<size_t> round;
+
+            for (size_t i = 0; i < steps.size(); ++i) {
+                bool ready = !steps[i].done;
+                for (size_t j = 0; ready && j < steps[i].inputs.size(); ++j) {
+                    const size_t node = steps[i].inputs[j];
+                    ready = (node < runs.size()) || steps[node - runs.size()].done;
+                }
+                if (ready) {
+                    round.push_back(i);
+                }
             }
 
-            l = dumpFiles.size();
+            std::vector<std::vector<size_t> > inputs(round.size());
+            std::vector<std::future<bool> > results;
+
+            for (size_t k = 0; k < round.size(); ++k) {
+                for (size_t node: steps[round[k]].inputs) {
+                    inputs[k].push_back(nodes[node]);
+                }
+
+                size_t * merged = &nodes[runs.size() + round[k]];
+
+                if (pool != nullptr && round.size() > 1) {
+                    results.push_back(pool->addTask([this, &inputs, k, merged](){
+                        return mergeRuns(inputs[k], *merged);
+                    }));
+                } else {
+                    ret = mergeRuns(inputs[k], *merged) && ret;
+                }
+            }
+
+            for (std::future<bool> & result: results) {
+                ret = result.get() && ret;
+            }
+
+            for (size_t i: round) {
+                steps[i].done = true;
+            }
+            left -= round.size();
         }
 
-        // grid merge sort (minimize data read!)
-        if (l > MERGE_SORT_WAY) { // assert: index increase -> size decrease
-            std::vector<std::string> files{std::move(dumpFiles)};
-            dumpFiles.clear(); // dumpFiles unspecified, clear dumpFiles
+        if (!ret) {
+            // Inputs of steps run are removed (failed outputs too), remove the runs left
+            std::vector<bool> consumed(nodes.size(), false);
 
-            if (!gridMergeSort(files.rbegin(), files.rend())) {
-                return false;
+            for (const mergeStep_t & step: steps) {
+                for (size_t j = 0; step.done && j < step.inputs.size(); ++j) {
+                    consumed[step.inputs[j]] = true;
+                }
+            }
+
+            for (size_t node = 0; node < nodes.size(); ++node) {
+                const bool ready = (node < runs.size()) || steps[node - runs.size()].done;
+                if (ready && !consumed[node]) {
+                    _store->removeRun(nodes[node]);
+                }
             }
 
-            l = dumpFiles.size();
+            return false;
+        }
+
+        for (size_t node: remain) {
+            dumpRuns.push_back(nodes[node]);
         }
 
         return true;
@@ -213,92 +342,196 @@ namespace ch {
 
     // Constructor
     template <typename DataType>
-    LocalFileManager<DataType>::LocalFileManager(const std::string & dir) : dumpFileDir{dir} {}
+    LocalFileManager<DataType>::LocalFileManager(const std::string & dir, uint32_t codec,
+                                                 codecMetrics_t * metrics, size_t memoryBudget,
+                                                 size_t mergeThreads)
+    : dumpFileDir{dir},
+      _mergeThreads{MAX_VAL((mergeThreads == 0) ? std::thread::hardware_concurrency()
+                                                : mergeThreads, 1)},
+      _store{std::make_shared<SegmentStore>(dir, _mergeThreads)}, _codec{codec},
+      _metrics{metrics},
+      _mergeWay{MIN_VAL(MAX_VAL(memoryBudget / _mergeThreads / MERGE_RUN_MEMORY,
+                                MIN_MERGE_WAY), MAX_MERGE_WAY)} {}
 
     // Move constructor
     template <typename DataType>
     LocalFileManager<DataType>::LocalFileManager(LocalFileManager<DataType> && o)
-                : dumpFileDir{o.dumpFileDir}, dumpFiles{std::move(o.dumpFiles)} {
+                : dumpFileDir{o.dumpFileDir}, _mergeThreads{o._mergeThreads},
+                  _store{std::move(o._store)}, dumpRuns{std::move(o.dumpRuns)},
+                  _codec{o._codec}, _metrics{o._metrics}, _mergeWay{o._mergeWay},
+                  _levels{std::move(o._levels)} {
 
-        o.dumpFiles.clear();
+        o.dumpRuns.clear();
+        o._levels.clear();
 
     }
 
-    // Move assignment
+    // Destructor
     template <typename DataType>
-    LocalFileManager<DataType> &
-        LocalFileManager<DataType>::operator = (LocalFileManager<DataType> && o) {
+    LocalFileManager<DataType>::~LocalFileManager() {
 
-        dumpFileDir = std::move(o.dumpFileDir);
+        clear();
+
+    }
 
-        dumpFiles = std::move(o.dumpFiles);
-        o.dumpFiles.clear();
+    // Remove all temporary runs
+    template <typename DataType>
+    void LocalFileManager<DataType>::clear() {
+
+        std::lock_guard<std::mutex> holder{_runsLock};
+
+        if (_store != nullptr) {
+            for (size_t run: dumpRuns) {
+                _store->removeRun(run);
+            }
+        }
 
-        return *this;
+        dumpRuns.clear();
+        _levels.clear();
 
     }
 
-    // Destructor
+    // Create a new run and open output block stream on it
     template <typename DataType>
-    LocalFileManager<DataType>::~LocalFileManager() {
+    bool LocalFileManager<DataType>::createRun(BlockWriter<DataType> & os, size_t & run) {
 
-        clear();
+        run = _store->createRun();
+
+        if (!os.open(_store, run)) {
+            _store->removeRun(run);
+            E("(LocalFileManager) Fail to create temporary run.");
+            return false;
+        }
+
+        return true;
 
     }
 
-    // Remove all temporary files
+    // Get output block stream of a new temporary run
     template <typename DataType>
-    void LocalFileManager<DataType>::clear() {
+    bool LocalFileManager<DataType>::getStream(BlockWriter<DataType> & os) {
+
+        size_t run;
 
-        for (const std::string & file: dumpFiles) {
-            unlink(file.c_str());
+        if (!createRun(os, run)) {
+            return false;
         }
 
-        dumpFiles.clear();
+        std::lock_guard<std::mutex> holder{_runsLock};
+
+        dumpRuns.push_back(run);
+
+        return true;
 
     }
 
-    // Get output file stream of a new temporary file
+    // Lowest level with at least way runs, false if there is none
     template <typename DataType>
-    bool LocalFileManager<DataType>::getStream(std::ofstream & os) {
-
-        dumpFiles.emplace_back(dumpFileDir);
-        std::string & fullPath = dumpFiles.back();
-        fullPath.append("/.", LENGTH_CONST_CHAR_ARRAY("/."));
-
-        // Create a valid temporary file path
-        size_t l = fullPath.size();
-        fullPath += randomString(RANDOM_FILE_NAME_LENGTH);
-        while (fileExist(fullPath.c_str())) {
-            fullPath.resize(l);
-            fullPath += randomString(RANDOM_FILE_NAME_LENGTH);
+    bool LocalFileManager<DataType>::findTier(size_t way, size_t & level) {
+
+        std::vector<size_t> counts;
+
+        for (size_t run: dumpRuns) {
+            auto it = _levels.find(run);
+            size_t l = (it == _levels.end()) ? 0 : it->second;
+            if (counts.size() <= l) {
+                counts.resize(l + 1, 0);
+            }
+            ++counts[l];
         }
 
-        os.open(fullPath);
-        if (!os) {
-            dumpFiles.pop_back();
-            E("(LocalFileManager) Fail to create temporary file.");
-            I("Check if there is no space.");
+        for (size_t l = 0; l < counts.size(); ++l) {
+            if (counts[l] >= way) {
+                level = l;
+                return true;
+            }
+        }
+
+        return false;
+
+    }
+
+    // Most runs merged at once
+    template <typename DataType>
+    inline size_t LocalFileManager<DataType>::mergeWay() const {
+
+        return _mergeWay;
+
+    }
+
+    // True if way runs of the same level can be merged
+    template <typename DataType>
+    bool LocalFileManager<DataType>::hasFullTier(size_t way) {
+
+        std::lock_guard<std::mutex> holder{_runsLock};
+
+        size_t level;
+
+        return (way > 1) && findTier(way, level);
+
+    }
+
+    // Merge way runs of the lowest level with at least way runs into one
+    // (size tiered, each record is rewritten once per level), false if merge failed
+    template <typename DataType>
+    bool LocalFileManager<DataType>::mergeTier(size_t way) {
+
+        std::vector<size_t> runs;
+        size_t level;
+
+        {
+            std::lock_guard<std::mutex> holder{_runsLock};
+
+            if (way < 2 || !findTier(way, level)) {
+                return true;
+            }
+
+            std::vector<size_t> remain;
+
+            for (size_t run: dumpRuns) {
+                auto it = _levels.find(run);
+                size_t l = (it == _levels.end()) ? 0 : it->second;
+                if (l == level && runs.size() < way) {
+                    if (it != _levels.end()) {
+                        _levels.erase(it);
+                    }
+                    runs.push_back(run);
+                } else {
+                    remain.push_back(run);
+                }
+            }
+
+            dumpRuns = std::move(remain);
+        }
+
+        size_t merged;
+
+        if (!mergeRuns(runs, merged)) {
             return false;
         }
 
+        std::lock_guard<std::mutex> holder{_runsLock};
+
+        _levels[merged] = level + 1;
+        dumpRuns.push_back(merged);
+
         return true;
 
     }
 
-    // Dump data to temporary file
+    // Dump data to a run
     template <typename DataType>
     bool LocalFileManager<DataType>::dumpToFile(std::vector<const DataType *> & data) {
 
-        std::ofstream os;
+        BlockWriter<DataType> os{_codec, _metrics};
 
         if (!getStream(os)) {
             return false;
         }
 
         for (size_t i = 0, l = data.size(); i < l; ++i) {
-            if (!(os << *(data[i]))) {
-                E("(LocalFileManager) Fail to write data to file.");
+            if (!os.write(*(data[i]))) {
+                E("(LocalFileManager) Fail to write data to run.");
                 I("Check if there is no space.");
 
                 // Clean the space
@@ -312,22 +545,65 @@ namespace ch {
             delete data[i];
         }
 
-        os.close();
         data.clear();
+
+        if (!os.close()) {
+            E("(LocalFileManager) Fail to write data to run.");
+            I("Check if there is no space.");
+            return false;
+        }
+
+        return true;
+
+    }
+
+    // Dump records of arena to a run in order of its index, arena is cleared
+    template <typename DataType>
+    bool LocalFileManager<DataType>::dumpToFile(RecordArena<DataType> & arena) {
+
+        BlockWriter<DataType> os{_codec, _metrics};
+
+        if (!getStream(os)) {
+            arena.clear();
+            return false;
+        }
+
+        bool ret = arena.writeTo(os);
+
+        arena.clear();
+
+        if (!os.close() || !ret) {
+            E("(LocalFileManager) Fail to write data to run.");
+            I("Check if there is no space.");
+            return false;
+        }
+
         return true;
 
     }
 
-    // Get sorted stream with all files
+    // Get sorted stream with all dump runs and sorted runs (owned by the stream)
     template <typename DataType>
-    SortedStream<DataType> * LocalFileManager<DataType>::getSortedStream() {
+    SortedStream<DataType> * LocalFileManager<DataType>::getSortedStream(
+        const std::vector<RunReader<DataType> *> & runs) {
 
         // Sort the data
         if (!doMergeSort()) {
+            for (RunReader<DataType> * run: runs) {
+                delete run;
+            }
             return nullptr;
         }
 
-        SortedStream<DataType> * ret = new SortedStream<DataType>{std::move(dumpFiles)};
+        SortedStream<DataType> * ret = new SortedStream<DataType>{};
+        for (size_t run: dumpRuns) {
+            ret->addRun(runReader(run));
+        }
+        dumpRuns.clear();
+        _levels.clear();
+        for (RunReader<DataType> * run: runs) {
+            ret->addRun(run);
+        }
         if (ret->isValid()) {
             return ret;
         } else {
@@ -337,11 +613,20 @@ namespace ch {
 
     }
 
-    // Get unsorted stream with all files
+    // Get unsorted stream with all dump runs and runs (owned by the stream)
     template <typename DataType>
-    UnsortedStream<DataType> * LocalFileManager<DataType>::getUnsortedStream() {
+    UnsortedStream<DataType> * LocalFileManager<DataType>::getUnsortedStream(
+        const std::vector<RunReader<DataType> *> & runs) {
 
-        UnsortedStream<DataType> * ret = new UnsortedStream<DataType>{std::move(dumpFiles)};
+        UnsortedStream<DataType> * ret = new UnsortedStream<DataType>{};
+        for (size_t run: dumpRuns) {
+            ret->addRun(runReader(run));
+        }
+        dumpRuns.clear();
+        _levels.clear();
+        for (RunReader<DataType> * run: runs) {
+            ret->addRun(run);
+        }
         if (ret->isValid()) {
             return ret;
         } else {
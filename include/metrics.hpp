@@ -0,0 +1,157 @@
+/*
+ * Job metrics: counters collected while a job runs
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h> // uint64_t
+
+#include <atomic>   // atomic
+#include <string>   // string
+
+namespace ch {
+
+    /*
+     * codecMetrics_t: compression counters of one kind of block stream
+     */
+    struct codecMetrics_t {
+
+        // Number of blocks encoded
+        std::atomic<uint64_t> blocks{0};
+
+        // Bytes before compression
+        std::atomic<uint64_t> rawBytes{0};
+
+        // Bytes after compression
+        std::atomic<uint64_t> storedBytes{0};
+
+        // CPU time spent on compression (ns)
+        std::atomic<uint64_t> compressTime{0};
+
+        // CPU time spent on decompression (ns)
+        std::atomic<uint64_t> decompressTime{0};
+
+        // Record an encoded block
+        void addCompression(uint64_t raw, uint64_t stored, uint64_t time);
+
+        // Record a decoded block
+        void addDecompression(uint64_t time);
+
+        // Compression ratio (raw / stored), 1 if nothing compressed
+        double ratio() const;
+
+        // Get string representation of the counters
+        std::string toString() const;
+    };
+
+    /*
+     * flowMetrics_t: counters of credit based flow control of shuffle streams
+     */
+    struct flowMetrics_t {
+
+        // Number of blocks held back for lack of credits
+        std::atomic<uint64_t> deferredBlocks{0};
+
+        // Bytes of held back blocks written to local disk
+        std::atomic<uint64_t> overflowBytes{0};
+
+        // Time blocked waiting for credits (ns)
+        std::atomic<uint64_t> waitTime{0};
+
+        // Get string representation of the counters
+        std::string toString() const;
+    };
+
+    /*
+     * skewMetrics_t: load of this machine and hot keys spread over all machines
+     */
+    struct skewMetrics_t {
+
+        // Records this machine received to reduce
+        std::atomic<uint64_t> reduceRecords{0};
+
+        // Keys found hot in samples of the map output (same on all machines)
+        std::atomic<uint64_t> hotKeys{0};
+
+        // Records of hot keys sent round robin instead of to the owner of the key
+        std::atomic<uint64_t> saltedRecords{0};
+
+        // Get string representation of the counters
+        std::string toString() const;
+    };
+
+    /*
+     * memoryMetrics_t: bytes of records held in memory by data managers of a job,
+     * shared by all of its StreamManagers as the memory budget
+     */
+    struct memoryMetrics_t {
+
+        // Bytes in memory now
+        std::atomic<uint64_t> current{0};
+
+        // Highest bytes in memory
+        std::atomic<uint64_t> peak{0};
+
+        // Bytes in memory handed to spill threads and not dumped yet (part of current)
+        std::atomic<uint64_t> spilling{0};
+
+        // Number of dumps of records in memory to runs
+        std::atomic<uint64_t> spills{0};
+
+        // Bytes of records dumped to runs
+        std::atomic<uint64_t> spilledBytes{0};
+
+        // Account bytes taken, returns bytes in memory
+        uint64_t reserve(uint64_t bytes);
+
+        // Account bytes freed
+        void release(uint64_t bytes);
+
+        // Account a dump of bytes in memory to a run
+        void addSpill(uint64_t bytes);
+
+        // Get string representation of the counters
+        std::string toString() const;
+    };
+
+    class Metrics {
+
+        public:
+
+            // Blocks sent between StreamManagers
+            codecMetrics_t shuffle;
+
+            // Blocks in temporary files
+            codecMetrics_t spill;
+
+            // Flow control of shuffle streams
+            flowMetrics_t flow;
+
+            // Partition skew
+            skewMetrics_t skew;
+
+            // Records in memory
+            memoryMetrics_t memory;
+
+            // Default constructor
+            Metrics() {}
+
+            // Copy constructor (deleted)
+            Metrics(const Metrics &) = delete;
+
+            // Copy assignment (deleted)
+            Metrics & operator = (const Metrics &) = delete;
+
+            // Get string representation of the metrics
+            std::string toString() const;
+    };
+
+    // CPU time consumed by the calling thread (ns)
+    uint64_t threadCPUTime();
+
+    // Monotonic wall clock time (ns)
+    uint64_t wallTime();
+}
+
+#endif
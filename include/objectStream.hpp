@@ -5,13 +5,28 @@
 #ifndef OBJECTSTREAM_H
 #define OBJECTSTREAM_H
 
-#include <unistd.h>  // close
-
-#include <string>    // string
-
-#include "def.hpp"   // INVALID_SOCKET, ID_INVALID
-#include "utils.hpp" // psend, sconnect, sendString
-#include "type.hpp"  // id_t
+#include <unistd.h>         // close, pread, pwrite, ftruncate, unlink
+#include <stdlib.h>         // mkstemp
+#include <string.h>         // memcpy
+#include <errno.h>          // errno, EINTR, EAGAIN
+#include <sys/socket.h>     // recv, send
+#include <poll.h>           // poll
+
+#include <string>           // string
+#include <deque>            // deque
+#include <mutex>            // mutex, lock_guard
+
+#include "def.hpp"          // INVALID_SOCKET, ID_INVALID, RECORD_BLOCK_SIZE, CODEC_NONE,
+                            // CREDIT_TIMEOUT
+#include "utils.hpp"        // psend, sconnect, sendString
+#include "type.hpp"         // id_t
+#include "compressor.hpp"   // blockHeader_t, encodeBlock, decodeBlock
+#include "metrics.hpp"      // codecMetrics_t, flowMetrics_t, wallTime
+
+// Do not raise SIGPIPE when peer closed the connection
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 namespace ch {
 
@@ -52,8 +67,8 @@ namespace ch {
             // Virtual Destructor
             virtual ~ObjectStream();
 
-            // Close the connection
-            virtual void close(void) = 0;
+            // Close the connection, false if data sent may not be received
+            virtual bool close(void) = 0;
 
             // True if the socket is valid
             bool isValid(void) const ;
@@ -67,13 +82,88 @@ namespace ch {
 
         protected:
 
+            // Codec of blocks
+            uint32_t _codec;
+
+            // Compression metrics
+            codecMetrics_t * _metrics;
+
+            // Serialized records not sent yet
+            std::string _block;
+
+            // Number of records in the block
+            uint32_t _count;
+
+            // Block to be sent (id, header and payload)
+            std::string _frame;
+
+            // Lock for the block, mappers may send concurrently
+            std::mutex _lock;
+
+            // True if the receiver grants credits
+            bool _flowControl;
+
+            // Blocks the receiver can accept now
+            uint32_t _credits;
+
+            // Credits given by the receiver, all are back once it consumed every block
+            uint32_t _maxCredits;
+
+            // Partially received credit grant
+            char _grant[sizeof(uint32_t)];
+
+            // Number of bytes in _grant
+            size_t _grantLength;
+
+            // Blocks held back for lack of credits
+            std::deque<std::string> _deferred;
+
+            // Bytes of _deferred
+            size_t _deferredSize;
+
+            // Limit of _deferredSize, further blocks overflow to disk
+            size_t _maxDeferredSize;
+
+            // Directory of the overflow file
+            std::string _overflowDir;
+
+            // Overflow file (unlinked once created)
+            int _overflowfd;
+
+            // Read and write offset of the overflow file
+            off_t _overflowRead;
+            off_t _overflowWrite;
+
+            // Flow control metrics
+            flowMetrics_t * _flowMetrics;
+
             void sendStopSignal(void);
 
+            // Send buffered records as a block
+            bool flushBlock(void);
+
+            // Read credit grants, block till at least one arrives if block is true
+            // (false if none arrives in CREDIT_TIMEOUT seconds)
+            bool receiveCredits(bool block);
+
+            // Send held back blocks while there are credits
+            // block till all of them are sent if block is true
+            bool sendDeferred(bool block);
+
+            // Hold back _frame in memory or overflow file
+            bool deferFrame(void);
+
+            // True if blocks are held back
+            bool hasDeferred(void) const;
+
         public:
 
             // Default constructor
             ObjectOutputStream();
 
+            // From value
+            ObjectOutputStream(int sockfd);
+
             // Copy constructor
             ObjectOutputStream(const ObjectOutputStream<DataType> & o) = delete;
 
@@ -93,17 +183,30 @@ namespace ch {
             bool open(const std::string & ip, unsigned short port);
 
             // Send signal that causes ObjectInputStream::recv return nullptr
-            void stop();
+            // false if blocks held back can not be sent
+            bool stop();
 
             // Send signal that causes ObjectInputStream::recv return nullptr
-            // close the connection as well
-            void close(void);
+            // close the connection as well once the receiver consumed all blocks
+            // false if blocks can not be sent or are not consumed
+            bool close(void);
 
-            // Send data through socket
-            bool send(const DataType & v) const ;
+            // Buffer data, send a block through socket if the block is full
+            bool send(const DataType & v);
+
+            // Send buffered data through socket
+            bool flush(void);
 
             // Send string through socket
             bool sendString(const std::string & str) const ;
+
+            // Set codec of blocks sent afterward
+            void setCompression(uint32_t codec, codecMetrics_t * metrics = nullptr);
+
+            // Enable credit based flow control, at most credits blocks in flight
+            // held back blocks exceeding maxDeferredSize bytes overflow to a file in dir
+            void setFlowControl(uint32_t credits, size_t maxDeferredSize, const std::string & dir,
+                                flowMetrics_t * metrics = nullptr);
     };
 
     /*
@@ -112,6 +215,32 @@ namespace ch {
     template <typename DataType>
     class ObjectInputStream: public ObjectStream {
 
+        protected:
+
+            // Compression metrics
+            codecMetrics_t * _metrics;
+
+            // Payload of current block
+            std::string _payload;
+
+            // Serialized records of current block
+            std::string _raw;
+
+            // Cursor in _raw
+            const char * _cursor;
+
+            // Number of records remain in current block
+            uint32_t _remain;
+
+            // True if the sender expects credits
+            bool _flowControl;
+
+            // True if the credit of current block is not granted yet
+            bool _granting;
+
+            // Receive next block, false if stop signal received or failed
+            bool receiveBlock(void);
+
         public:
 
             // From value
@@ -133,11 +262,23 @@ namespace ch {
             ~ObjectInputStream();
 
             // Close the connection
-            void close(void);
+            bool close(void);
 
             // Receive data, return pointer to data if success
             // return nullptr if failed
-            DataType * recv(void) const;
+            DataType * recv(void);
+
+            // Receive data to v, false if failed
+            bool recv(DataType & v);
+
+            // True if records of a received block remain
+            bool hasBuffered(void) const;
+
+            // Set metrics of decompression
+            void setMetrics(codecMetrics_t * metrics);
+
+            // Grant a credit to the sender for each consumed block
+            void setFlowControl(bool enabled);
     };
 
     /********************************************
@@ -184,14 +325,261 @@ namespace ch {
 
     }
 
+    // Send buffered records as a block
+    template <typename DataType>
+    bool ObjectOutputStream<DataType>::flushBlock(void) {
+
+        if (_count == 0) {
+            return true;
+        }
+
+        _frame.clear();
+        _frame.push_back(static_cast<char>(DataType::getId()));
+        encodeBlock(_block, _count, _codec, _frame, _metrics);
+        _block.clear();
+        _count = 0;
+
+        if (_flowControl) {
+            // Earlier blocks go first, hold back the block if there is no credit
+            if (!sendDeferred(false)) {
+                return false;
+            }
+            // Grants may be waiting on the socket though nothing was deferred
+            if (_credits == 0 && !receiveCredits(false)) {
+                return false;
+            }
+            if (_credits == 0 || hasDeferred()) {
+                return deferFrame();
+            }
+            --_credits;
+        }
+
+        if (!psend(_sockfd, static_cast<const void *>(_frame.data()), _frame.size())) {
+            D("ObjectOutputStream: Failed sending block.");
+            return false;
+        }
+
+        return true;
+
+    }
+
+    // Read credit grants, block till at least one arrives if block is true
+    // (false if none arrives in CREDIT_TIMEOUT seconds)
+    template <typename DataType>
+    bool ObjectOutputStream<DataType>::receiveCredits(bool block) {
+
+        while (true) {
+            if (block) {
+                struct pollfd pfd = {_sockfd, POLLIN, 0};
+                int ready = poll(&pfd, 1, CREDIT_TIMEOUT * 1000);
+
+                if (ready == 0) {
+                    E("(ObjectOutputStream) No credit granted in time, the receiver is stuck.");
+                    return false;
+                } else if (ready < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    D("ObjectOutputStream: Failed polling for credits.");
+                    return false;
+                }
+            }
+
+            ssize_t n = ::recv(_sockfd, static_cast<void *>(_grant + _grantLength),
+                               sizeof(uint32_t) - _grantLength, block ? 0 : MSG_DONTWAIT);
+
+            if (n > 0) {
+                _grantLength += n;
+                if (_grantLength == sizeof(uint32_t)) {
+                    uint32_t granted;
+                    memcpy(&granted, _grant, sizeof(uint32_t));
+                    _credits += granted;
+                    _grantLength = 0;
+                    // Got one, drain the rest without blocking
+                    block = false;
+                }
+            } else if (n == 0) {
+                // The receiver closes once it consumed every block
+                if (_credits == _maxCredits && _grantLength == 0) {
+                    return true;
+                }
+                D("ObjectOutputStream: Receiver closed while waiting for credits.");
+                return false;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            } else if (errno != EINTR) {
+                D("ObjectOutputStream: Failed receiving credits.");
+                return false;
+            }
+        }
+
+    }
+
+    // Send held back blocks while there are credits
+    // block till all of them are sent if block is true
+    template <typename DataType>
+    bool ObjectOutputStream<DataType>::sendDeferred(bool block) {
+
+        if (!hasDeferred()) {
+            return true;
+        }
+
+        if (!receiveCredits(false)) {
+            return false;
+        }
+
+        std::string frame;
+
+        while (hasDeferred()) {
+            if (_credits == 0) {
+                if (!block) {
+                    return true;
+                }
+
+                uint64_t start = wallTime();
+                if (!receiveCredits(true)) {
+                    return false;
+                }
+                if (_flowMetrics != nullptr) {
+                    _flowMetrics->waitTime += wallTime() - start;
+                }
+                continue;
+            }
+
+            // Memory first, then the overflow file (order of blocks does not matter)
+            if (!_deferred.empty()) {
+                frame = std::move(_deferred.front());
+                _deferred.pop_front();
+                _deferredSize -= frame.size();
+            } else {
+                blockHeader_t header;
+                frame.resize(sizeof(id_t) + sizeof(blockHeader_t));
+                if (pread(_overflowfd, &frame[0], frame.size(), _overflowRead) !=
+                    static_cast<ssize_t>(frame.size())) {
+                    E("(ObjectOutputStream) Fail to read overflow file.");
+                    return false;
+                }
+                memcpy(&header, frame.data() + sizeof(id_t), sizeof(blockHeader_t));
+                frame.resize(frame.size() + header.storedLength);
+                if (header.storedLength > 0 &&
+                    pread(_overflowfd, &frame[sizeof(id_t) + sizeof(blockHeader_t)],
+                          header.storedLength, _overflowRead + sizeof(id_t) + sizeof(blockHeader_t)) !=
+                    static_cast<ssize_t>(header.storedLength)) {
+                    E("(ObjectOutputStream) Fail to read overflow file.");
+                    return false;
+                }
+                _overflowRead += frame.size();
+                if (_overflowRead == _overflowWrite) {
+                    // Reuse the space
+                    _overflowRead = _overflowWrite = 0;
+                    if (ftruncate(_overflowfd, 0) < 0) {
+                        D("ObjectOutputStream: Failed truncating overflow file.");
+                    }
+                }
+            }
+
+            --_credits;
+
+            if (!psend(_sockfd, static_cast<const void *>(frame.data()), frame.size())) {
+                D("ObjectOutputStream: Failed sending block.");
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+    // Hold back _frame in memory or overflow file
+    template <typename DataType>
+    bool ObjectOutputStream<DataType>::deferFrame(void) {
+
+        if (_flowMetrics != nullptr) {
+            ++(_flowMetrics->deferredBlocks);
+        }
+
+        if (_deferredSize + _frame.size() <= _maxDeferredSize) {
+            _deferredSize += _frame.size();
+            _deferred.push_back(std::move(_frame));
+            _frame = std::string{};
+            return true;
+        }
+
+        if (_overflowfd < 0) {
+            std::string path = _overflowDir + "/.overflowXXXXXX";
+            _overflowfd = mkstemp(&path[0]);
+            if (_overflowfd < 0) {
+                E("(ObjectOutputStream) Fail to create overflow file.");
+                I("Check if the working directory is writable.");
+                return false;
+            }
+            unlink(path.c_str());
+        }
+
+        if (pwrite(_overflowfd, _frame.data(), _frame.size(), _overflowWrite) !=
+            static_cast<ssize_t>(_frame.size())) {
+            E("(ObjectOutputStream) Fail to write overflow file.");
+            I("Check if there is no space.");
+            return false;
+        }
+        _overflowWrite += _frame.size();
+
+        if (_flowMetrics != nullptr) {
+            _flowMetrics->overflowBytes += _frame.size();
+        }
+
+        return true;
+
+    }
+
+    // True if blocks are held back
+    template <typename DataType>
+    inline bool ObjectOutputStream<DataType>::hasDeferred(void) const {
+
+        return !_deferred.empty() || _overflowRead != _overflowWrite;
+
+    }
+
     // Default constructor
     template <typename DataType>
-    ObjectOutputStream<DataType>::ObjectOutputStream() {}
+    ObjectOutputStream<DataType>::ObjectOutputStream()
+    : _codec{CODEC_NONE}, _metrics{nullptr}, _count{0}, _flowControl{false}, _credits{0},
+      _maxCredits{0}, _grantLength{0}, _deferredSize{0}, _maxDeferredSize{0}, _overflowfd{-1},
+      _overflowRead{0}, _overflowWrite{0}, _flowMetrics{nullptr} {
+
+        _block.reserve(RECORD_BLOCK_SIZE + BUFFER_SIZE);
+
+    }
+
+    // From value
+    template <typename DataType>
+    ObjectOutputStream<DataType>::ObjectOutputStream(int sockfd)
+    : ObjectOutputStream() {
+
+        _sockfd = sockfd;
+
+    }
 
     // Move constructor
     template <typename DataType>
     ObjectOutputStream<DataType>::ObjectOutputStream(ObjectOutputStream<DataType> && o)
-    : ObjectStream{std::move(o)} {}
+    : ObjectStream{std::move(o)}, _codec{o._codec}, _metrics{o._metrics},
+      _block{std::move(o._block)}, _count{o._count}, _flowControl{o._flowControl},
+      _credits{o._credits}, _maxCredits{o._maxCredits}, _grantLength{o._grantLength},
+      _deferred{std::move(o._deferred)},
+      _deferredSize{o._deferredSize}, _maxDeferredSize{o._maxDeferredSize},
+      _overflowDir{std::move(o._overflowDir)}, _overflowfd{o._overflowfd},
+      _overflowRead{o._overflowRead}, _overflowWrite{o._overflowWrite},
+      _flowMetrics{o._flowMetrics} {
+
+        memcpy(_grant, o._grant, sizeof(uint32_t));
+        o._count = 0;
+        o._deferred.clear();
+        o._deferredSize = 0;
+        o._overflowfd = -1;
+        o._overflowRead = o._overflowWrite = 0;
+
+    }
 
     // Move assignment
     template <typename DataType>
@@ -200,6 +588,31 @@ namespace ch {
 
         _sockfd = o._sockfd;
         o._sockfd = INVALID_SOCKET;
+        _codec = o._codec;
+        _metrics = o._metrics;
+        _block = std::move(o._block);
+        _count = o._count;
+        o._count = 0;
+        _flowControl = o._flowControl;
+        _credits = o._credits;
+        _maxCredits = o._maxCredits;
+        memcpy(_grant, o._grant, sizeof(uint32_t));
+        _grantLength = o._grantLength;
+        _deferred = std::move(o._deferred);
+        o._deferred.clear();
+        _deferredSize = o._deferredSize;
+        o._deferredSize = 0;
+        _maxDeferredSize = o._maxDeferredSize;
+        _overflowDir = std::move(o._overflowDir);
+        if (_overflowfd >= 0) {
+            ::close(_overflowfd);
+        }
+        _overflowfd = o._overflowfd;
+        o._overflowfd = -1;
+        _overflowRead = o._overflowRead;
+        _overflowWrite = o._overflowWrite;
+        o._overflowRead = o._overflowWrite = 0;
+        _flowMetrics = o._flowMetrics;
         return *this;
 
     }
@@ -208,6 +621,9 @@ namespace ch {
     template <typename DataType>
     ObjectOutputStream<DataType>::~ObjectOutputStream() {
         close();
+        if (_overflowfd >= 0) {
+            ::close(_overflowfd);
+        }
     }
 
     // Connect to an given ip at given port
@@ -221,43 +637,80 @@ namespace ch {
     }
 
     // Send signal that causes ObjectInputStream::recv return nullptr
+    // false if blocks held back can not be sent
     template <typename DataType>
-    void ObjectOutputStream<DataType>::stop() {
+    bool ObjectOutputStream<DataType>::stop() {
 
-        if (isValid()) {
-            sendStopSignal();
+        std::lock_guard<std::mutex> holder{_lock};
+
+        if (!isValid()) {
+            return false;
         }
 
+        // Receiver is still receiving, wait for credits of held back blocks
+        const bool ret = flushBlock() && sendDeferred(true);
+
+        sendStopSignal();
+
+        return ret;
+
     }
 
     // Send signal that causes ObjectInputStream::recv return nullptr
     // close the connection as well
+    // false if blocks can not be sent or are not consumed
     template <typename DataType>
-    void ObjectOutputStream<DataType>::close(void) {
+    bool ObjectOutputStream<DataType>::close(void) {
 
-        if (isValid()) {
-            sendStopSignal();
-            ::close(_sockfd);
-            _sockfd = INVALID_SOCKET;
+        std::lock_guard<std::mutex> holder{_lock};
+
+        if (!isValid()) {
+            return true;
         }
 
+        bool ret = flushBlock() && sendDeferred(true);
+
+        sendStopSignal();
+
+        // Credits of the last blocks come back once they are consumed, the receiver never
+        // grants to a closed connection
+        while (ret && _flowControl && _credits < _maxCredits) {
+            ret = receiveCredits(true);
+        }
+
+        ::close(_sockfd);
+        _sockfd = INVALID_SOCKET;
+
+        return ret;
+
     }
 
-    // Send data through socket
+    // Buffer data, send a block through socket if the block is full
     template <typename DataType>
-    bool ObjectOutputStream<DataType>::send(const DataType & v) const {
+    bool ObjectOutputStream<DataType>::send(const DataType & v) {
 
         DSS("ObjectOutputStream: Sending " << v);
 
-        id_t id = DataType::getId();
+        std::lock_guard<std::mutex> holder{_lock};
 
-        if (psend(_sockfd, static_cast<const void *>(&id), sizeof(id_t))) {
-            return v.send(_sockfd);
-        } else {
-            DSS("ObjectOutputStream: Failed sending " << v);
+        v.pack(_block);
+        ++_count;
+
+        if (_block.size() >= RECORD_BLOCK_SIZE) {
+            return flushBlock();
         }
 
-        return false;
+        return true;
+
+    }
+
+    // Send buffered data through socket
+    template <typename DataType>
+    bool ObjectOutputStream<DataType>::flush(void) {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        return flushBlock();
 
     }
 
@@ -269,14 +722,89 @@ namespace ch {
 
     }
 
+    // Set codec of blocks sent afterward
+    template <typename DataType>
+    void ObjectOutputStream<DataType>::setCompression(uint32_t codec, codecMetrics_t * metrics) {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        _codec = codec;
+        _metrics = metrics;
+
+    }
+
+    // Enable credit based flow control, at most credits blocks in flight
+    // held back blocks exceeding maxDeferredSize bytes overflow to a file in dir
+    template <typename DataType>
+    void ObjectOutputStream<DataType>::setFlowControl(uint32_t credits, size_t maxDeferredSize,
+                                                      const std::string & dir,
+                                                      flowMetrics_t * metrics) {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        _flowControl = (credits > 0);
+        _credits = credits;
+        _maxCredits = credits;
+        _maxDeferredSize = maxDeferredSize;
+        _overflowDir = dir;
+        _flowMetrics = metrics;
+
+    }
+
+    // Receive next block, false if stop signal received or failed
+    template <typename DataType>
+    bool ObjectInputStream<DataType>::receiveBlock(void) {
+
+        id_t id = ID_INVALID;
+        blockHeader_t header;
+
+        do {
+            if (!precv(_sockfd, static_cast<void *>(&id), sizeof(id_t)) ||
+                id != DataType::getId()) {
+                return false;
+            }
+
+            if (!precv(_sockfd, static_cast<void *>(&header), sizeof(blockHeader_t))) {
+                return false;
+            }
+
+            if (header.storedLength > MAX_RECORD_BLOCK_SIZE ||
+                header.rawLength > MAX_RECORD_BLOCK_SIZE) {
+                E("(ObjectInputStream) Corrupted block header.");
+                return false;
+            }
+
+            _payload.resize(header.storedLength);
+            if (!precv(_sockfd, static_cast<void *>(&_payload[0]), header.storedLength) ||
+                !decodeBlock(header, _payload.data(), _raw, _metrics)) {
+                return false;
+            }
+        } while (header.count == 0);
+
+        _cursor = _raw.data();
+        _remain = header.count;
+        _granting = _flowControl;
+
+        return true;
+
+    }
+
     // From value
     template <typename DataType>
-    ObjectInputStream<DataType>::ObjectInputStream(int sockfd): ObjectStream{sockfd} {}
+    ObjectInputStream<DataType>::ObjectInputStream(int sockfd)
+    : ObjectStream{sockfd}, _metrics{nullptr}, _cursor{nullptr}, _remain{0},
+      _flowControl{false}, _granting{false} {}
 
     // Move constructor
     template <typename DataType>
     ObjectInputStream<DataType>::ObjectInputStream(ObjectInputStream<DataType> && o)
-    : ObjectStream{std::move(o)} {}
+    : ObjectStream{std::move(o)}, _metrics{o._metrics}, _payload{std::move(o._payload)},
+      _raw{std::move(o._raw)}, _cursor{o._cursor}, _remain{o._remain},
+      _flowControl{o._flowControl}, _granting{o._granting} {
+
+        o._remain = 0;
+
+    }
 
     // Move assignment
     template <typename DataType>
@@ -285,6 +813,14 @@ namespace ch {
 
         _sockfd = o._sockfd;
         o._sockfd = INVALID_SOCKET;
+        _metrics = o._metrics;
+        _payload = std::move(o._payload);
+        _raw = std::move(o._raw);
+        _cursor = o._cursor;
+        _remain = o._remain;
+        o._remain = 0;
+        _flowControl = o._flowControl;
+        _granting = o._granting;
         return *this;
 
     }
@@ -299,38 +835,85 @@ namespace ch {
 
     // Close the connection
     template <typename DataType>
-    void ObjectInputStream<DataType>::close(void) {
+    bool ObjectInputStream<DataType>::close(void) {
 
         if (isValid()) {
             ::close(_sockfd);
             _sockfd = INVALID_SOCKET;
         }
 
+        return true;
+
     }
 
     // Receive data, return pointer to data if success
     // return nullptr if failed
     template <typename DataType>
-    DataType * ObjectInputStream<DataType>::recv(void) const {
+    DataType * ObjectInputStream<DataType>::recv(void) {
 
-        id_t id = ID_INVALID;
+        DataType * v = new DataType{};
 
-        if (precv(_sockfd, static_cast<void *>(&id), sizeof(id_t))) {
-            if (id == DataType::getId()) {
-                DataType * v = new DataType{};
+        if (!recv(*v)) {
+            delete v;
+            return nullptr;
+        }
 
-                if (!(v->recv(_sockfd))) {
-                    delete v;
-                    return nullptr;
-                }
+        return v;
 
-                DSS("ObjectInputStream: Received " << (*v));
+    }
+
+    // Receive data to v, false if failed
+    template <typename DataType>
+    bool ObjectInputStream<DataType>::recv(DataType & v) {
 
-                return v;
+        if (_remain == 0 && !receiveBlock()) {
+            return false;
+        }
+
+        if (!v.unpack(_cursor, _raw.data() + _raw.size())) {
+            E("(ObjectInputStream) Corrupted record.");
+            _remain = 0;
+            return false;
+        }
+        --_remain;
+
+        // Records of the block are consumed, return its credit
+        if (_remain == 0 && _granting) {
+            const uint32_t granted = 1;
+            _granting = false;
+            if (!psend(_sockfd, static_cast<const void *>(&granted), sizeof(uint32_t))) {
+                E("(ObjectInputStream) Fail to return a credit, the sender is lost.");
+                return false;
             }
         }
 
-        return nullptr;
+        DSS("ObjectInputStream: Received " << v);
+
+        return true;
+
+    }
+
+    // True if records of a received block remain
+    template <typename DataType>
+    inline bool ObjectInputStream<DataType>::hasBuffered(void) const {
+
+        return (_remain != 0);
+
+    }
+
+    // Set metrics of decompression
+    template <typename DataType>
+    void ObjectInputStream<DataType>::setMetrics(codecMetrics_t * metrics) {
+
+        _metrics = metrics;
+
+    }
+
+    // Grant a credit to the sender for each consumed block
+    template <typename DataType>
+    void ObjectInputStream<DataType>::setFlowControl(bool enabled) {
+
+        _flowControl = enabled;
 
     }
 }
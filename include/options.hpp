@@ -0,0 +1,144 @@
+/*
+ * Options of a job
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdint.h> // uint32_t
+#include <cstddef>  // size_t
+
+#include <vector>   // vector
+
+#include "def.hpp"  // DEFAULT_MEMORY_BUDGET, DEFAULT_MAX_DATA_SIZE, CODEC_xxx, OUTPUT_xxx,
+                    // TEXT_xxx, PARTITION_xxx, REDUCE_xxx
+
+namespace ch {
+
+    /*
+     * options_t: per job tuning, passed to the job templates
+     */
+    struct options_t {
+
+        // Bytes of records in memory of all StreamManagers of the job on a machine, a data
+        // manager holding at least MIN_SPILL_SIZE bytes dumps to file when it is exceeded
+        // (0: no limit)
+        size_t memoryBudget;
+
+        // Dump to file if number of records in memory of a data manager reach the threshold
+        // (0: no limit)
+        size_t maxDataSize;
+
+        // Codec of blocks sent between StreamManagers
+        uint32_t shuffleCodec;
+
+        // Codec of blocks in temporary files
+        uint32_t spillCodec;
+
+        // Blocks a sender may have in flight to a receiver, 0 disables flow control
+        // (must be the same on all machines)
+        uint32_t shuffleCredits;
+
+        // Bytes of blocks a sender holds in memory when the receiver grants no credit,
+        // further blocks are written to local disk
+        size_t maxDeferredSize;
+
+        // Merge sorted temporary files in background while data is still received
+        bool backgroundMerge;
+
+        // Buffers of a data manager, each with its own lock and dumped on its own; storing
+        // threads (receivers, mappers) are spread over them
+        size_t storeShards;
+
+        // Threads sorting data in memory before it is dumped (0: all cores)
+        size_t sortThreads;
+
+        // Threads running independent merges of temporary runs before the final merge
+        // (0: all cores), fan-in is chosen from the memory budget left to each
+        size_t mergeThreads;
+
+        // Data still in memory when a stream is taken is read from memory (merged with the
+        // files) instead of being dumped to file first
+        bool memoryRuns;
+
+        // Sort and dump full data in memory on a background thread while records are stored
+        // into a second buffer (memory budget is split between the two)
+        bool asyncSpill;
+
+        // Keep records in memory serialized in contiguous chunks and sort an index of key
+        // prefixes, instead of one allocated object per record
+        bool arenaStorage;
+
+        // OUTPUT_SINGLE: reducer output is sent to master and written to the output file
+        // OUTPUT_PARTS: each machine writes its reducer output to a part file in the output directory
+        uint32_t outputMode;
+
+        // Lines of text output: TEXT_REPR as toString, TEXT_CSV or TEXT_TSV with a field per
+        // member of a tuple
+        uint32_t textFormat;
+
+        // Reducer output is written as a record file (blocks of serialized records as in
+        // temporary files, compressed by outputCodec) instead of text; a job given a record file
+        // as input gets splits of whole blocks and its mapper reads them with SplitReader
+        bool binaryOutput;
+
+        // Codec of blocks of binary output
+        uint32_t outputCodec;
+
+        // PARTITION_HASH: map output is partitioned by hash code
+        // PARTITION_RANGE: map output is kept locally, sampled, and then partitioned by key ranges
+        // chosen from samples of all machines; with OUTPUT_PARTS the part files in order of id
+        // form a totally ordered output
+        uint32_t partitionMode;
+
+        // Records sampled per machine to choose key ranges or balance virtual partitions
+        size_t rangeSamples;
+
+        // Number of virtual partitions hashed to, assigned to machines through a table
+        // (0: one partition per machine)
+        size_t virtualPartitions;
+
+        // Share of virtual partitions of each machine by id (equal if empty)
+        std::vector<double> partitionWeights;
+
+        // Assign virtual partitions by their load in a sample of map output, which is kept
+        // locally till all machines agree on the table (as PARTITION_RANGE does)
+        bool balancePartitions;
+
+        // REDUCE_SORT: records received are sorted and merged, reducer reads groups by key in order
+        // REDUCE_HASH: records received are combined by key in a hash table spilled by hash over
+        // the memory budget, reducer reads one record per key in no order (for order-insensitive
+        // aggregates such as sums); the job must specialize recordCombine_t (e.g. sumValues_t)
+        uint32_t reduceMode;
+
+        // Reducer threads on each machine, map output is spread over as many local buckets by hash
+        // (not with PARTITION_RANGE), the reducer must be thread safe if more than one
+        size_t reduceThreads;
+
+        // Spread records of hot keys over all machines (simpleJob, not with sampled partitioning),
+        // the partial results of a hot key are reduced again on the machine owning the key,
+        // so the reducer must accept its own output as input (e.g. sum)
+        bool skewMitigation;
+
+        // First records of map output counted per machine to find hot keys
+        size_t skewSamples;
+
+        // A key is hot if it takes at least this share of the samples of a machine
+        double hotKeyShare;
+
+        options_t()
+        : memoryBudget{DEFAULT_MEMORY_BUDGET}, maxDataSize{DEFAULT_MAX_DATA_SIZE},
+          shuffleCodec{CODEC_NONE}, spillCodec{CODEC_NONE},
+          shuffleCredits{DEFAULT_SHUFFLE_CREDITS}, maxDeferredSize{DEFAULT_MAX_DEFERRED_SIZE},
+          backgroundMerge{true}, storeShards{DEFAULT_STORE_SHARDS},
+          sortThreads{0}, mergeThreads{0}, memoryRuns{true}, asyncSpill{true}, arenaStorage{false},
+          outputMode{OUTPUT_SINGLE}, textFormat{TEXT_REPR}, binaryOutput{false},
+          outputCodec{CODEC_NONE},
+          partitionMode{PARTITION_HASH}, rangeSamples{DEFAULT_RANGE_SAMPLES},
+          virtualPartitions{0}, balancePartitions{false}, reduceMode{REDUCE_SORT}, reduceThreads{1},
+          skewMitigation{false}, skewSamples{DEFAULT_SKEW_SAMPLES},
+          hotKeyShare{DEFAULT_HOT_KEY_SHARE} {}
+    };
+}
+
+#endif
@@ -6,8 +6,11 @@
 #ifndef PARTITIONER_H
 #define PARTITIONER_H
 
-#include <climits> // INT_MIN
-#include <cstddef> // size_t
+#include <climits>   // INT_MIN
+#include <cstddef>   // size_t
+#include <vector>    // vector
+#include <algorithm> // upper_bound, binary_search, sort, unique, stable_sort
+#include <utility>   // move
 
 namespace ch {
 
@@ -46,6 +49,175 @@ namespace ch {
             }
     } zeroPartitioner;
 
+    /*
+     * VirtualPartitioner: Hash to one of P virtual partitions,
+     * which are assigned to machines through a table
+     */
+    class VirtualPartitioner: public Partitioner {
+
+        protected:
+
+            // Machine of each virtual partition
+            std::vector<size_t> _table;
+
+        public:
+
+            explicit VirtualPartitioner(size_t partitions = 0): _table(partitions, 0) {}
+
+            // Number of virtual partitions
+            size_t partitions() const {
+                return _table.size();
+            }
+
+            // Get the virtual partition of a hash code
+            size_t getVirtualPartition(int i) const {
+                if (i == INT_MIN) {
+                    return 0;
+                }
+                return ((i < 0) ? -i : i) % _table.size();
+            }
+
+            size_t getPartition(int i, int s) const {
+                return _table[getVirtualPartition(i)];
+            }
+
+            // Get the machine of a virtual partition
+            size_t getMachine(size_t partition) const {
+                return _table[partition];
+            }
+
+            // Move a virtual partition to a machine
+            void assign(size_t partition, size_t machine) {
+                _table[partition] = machine;
+            }
+
+            // Assign consecutive virtual partitions to machines in proportion to weights
+            // (indexed by id of machine, equal if empty)
+            void assignByWeight(size_t machines, const std::vector<double> & weights) {
+                const size_t p = _table.size();
+                double total = 0;
+
+                for (size_t m = 0; m < machines; ++m) {
+                    total += (m < weights.size()) ? weights[m] : 1;
+                }
+
+                size_t m = 0;
+                double bound = (weights.empty()) ? 1 : weights[0];
+
+                for (size_t i = 0; i < p; ++i) {
+                    // Middle of the partition in weight space
+                    const double at = (i + 0.5) * total / p;
+
+                    while (at > bound && m + 1 < machines) {
+                        ++m;
+                        bound += (m < weights.size()) ? weights[m] : 1;
+                    }
+                    _table[i] = m;
+                }
+            }
+
+            // Assign virtual partitions to machines balancing load divided by weight of machine,
+            // heaviest partitions first
+            void balance(size_t machines, const std::vector<size_t> & loads,
+                         const std::vector<double> & weights) {
+                const size_t p = _table.size();
+                std::vector<size_t> order(p);
+
+                for (size_t i = 0; i < p; ++i) {
+                    order[i] = i;
+                }
+                std::stable_sort(order.begin(), order.end(), [&loads](size_t a, size_t b) {
+                    return loads[a] > loads[b];
+                });
+
+                std::vector<double> assigned(machines, 0);
+
+                for (size_t i: order) {
+                    size_t best = 0;
+                    double bestLoad = 0;
+
+                    for (size_t m = 0; m < machines; ++m) {
+                        const double w = (m < weights.size() && weights[m] > 0) ? weights[m] : 1;
+                        const double load = (assigned[m] + loads[i] + 1) / w;
+
+                        if (m == 0 || load < bestLoad) {
+                            best = m;
+                            bestLoad = load;
+                        }
+                    }
+                    assigned[best] += loads[i] + 1;
+                    _table[i] = best;
+                }
+            }
+    };
+
+    /*
+     * RangePartitioner: Map to the machine owning the key range
+     * splits[i - 1] <= v < splits[i] goes to machine i, so machine i holds keys
+     * less than those of machine i + 1
+     */
+    template <typename DataType>
+    class RangePartitioner {
+
+        protected:
+
+            // Split points in ascending order (machines - 1 of them)
+            std::vector<DataType> _splits;
+
+        public:
+
+            // Choose split points at quantiles of sorted samples, s is the number of machines
+            void setSplits(const std::vector<DataType> & samples, size_t s) {
+                _splits.clear();
+
+                const size_t n = samples.size();
+
+                if (n == 0) {
+                    return;
+                }
+
+                for (size_t i = 1; i < s; ++i) {
+                    _splits.push_back(samples[i * n / s]);
+                }
+            }
+
+            // Get the partition of a record
+            size_t getPartition(const DataType & v) const {
+                return std::upper_bound(_splits.begin(), _splits.end(), v) - _splits.begin();
+            }
+    };
+
+
+    /*
+     * HotKeys: keys too frequent to be sent to one machine
+     */
+    template <typename DataType>
+    class HotKeys {
+
+        protected:
+
+            // Hot keys in ascending order
+            std::vector<DataType> _keys;
+
+        public:
+
+            // Set hot keys (duplicated keys are removed)
+            void setKeys(std::vector<DataType> && keys) {
+                _keys = std::move(keys);
+                std::sort(_keys.begin(), _keys.end());
+                _keys.erase(std::unique(_keys.begin(), _keys.end()), _keys.end());
+            }
+
+            // True if key of v is hot
+            bool contains(const DataType & v) const {
+                return std::binary_search(_keys.begin(), _keys.end(), v);
+            }
+
+            // Number of hot keys
+            size_t size() const {
+                return _keys.size();
+            }
+    };
 }
 
 #endif
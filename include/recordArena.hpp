@@ -0,0 +1,219 @@
+/*
+ * Serialized records in large contiguous chunks, sorted through a compact index
+ */
+
+#ifndef RECORDARENA_H
+#define RECORDARENA_H
+
+#include <stdint.h>        // uint64_t, uint32_t
+
+#include <vector>          // vector
+#include <string>          // string
+#include <algorithm>       // sort, swap
+
+#include "def.hpp"         // ARENA_CHUNK_SIZE
+#include "blockStream.hpp" // BlockWriter
+#include "recordOrder.hpp" // recordOrder_t
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    template <typename DataType>
+    class RecordArena {
+
+        protected:
+
+            /*
+             * Index entry of a record
+             */
+            struct entry_t {
+                uint64_t prefix;  // order preserving prefix of the key
+                uint32_t chunk;   // chunk holding the record
+                uint32_t offset;  // offset of the record in the chunk
+                uint32_t length;  // length of the serialized record
+                uint32_t exact;   // 1 if equal prefixes mean equal keys
+            };
+
+            // Chunks of serialized records (kept allocated after clear)
+            std::vector<std::string> _chunks;
+
+            // Chunk records are appended to
+            size_t _current;
+
+            // Index of records in order of storing (or sorted)
+            std::vector<entry_t> _index;
+
+            // Serialized record being stored
+            std::string _scratch;
+
+            // Records compared when prefixes do not decide the order
+            DataType _left;
+            DataType _right;
+
+            // Unpack a record
+            void unpackEntry(const entry_t & e, DataType & v) const;
+
+        public:
+
+            // Constructor
+            RecordArena();
+
+            // Copy constructor (deleted)
+            RecordArena(const RecordArena<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            RecordArena<DataType> & operator = (const RecordArena<DataType> &) = delete;
+
+            // Serialize a record into the arena, returns bytes it takes
+            size_t add(const DataType & v);
+
+            // Number of records
+            size_t size() const;
+
+            // Unpack i-th record in order of the index
+            bool get(size_t i, DataType & v) const;
+
+            // Sort records (recordOrder_t)
+            void sort();
+
+            // Write records in order of the index
+            bool writeTo(BlockWriter<DataType> & os) const;
+
+            // Remove all records (memory of chunks is reused)
+            void clear();
+
+            // Exchange records with another arena
+            void swap(RecordArena<DataType> & o);
+    };
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Unpack a record
+    template <typename DataType>
+    inline void RecordArena<DataType>::unpackEntry(const entry_t & e, DataType & v) const {
+
+        const char * cur = _chunks[e.chunk].data() + e.offset;
+        v.unpack(cur, cur + e.length);
+
+    }
+
+    // Constructor
+    template <typename DataType>
+    RecordArena<DataType>::RecordArena(): _current{0} {}
+
+    // Serialize a record into the arena, returns bytes it takes
+    template <typename DataType>
+    size_t RecordArena<DataType>::add(const DataType & v) {
+
+        _scratch.clear();
+        v.pack(_scratch);
+
+        const size_t length = _scratch.size();
+
+        if (_chunks.empty()) {
+            _chunks.emplace_back();
+            _chunks.back().reserve(MAX_VAL(ARENA_CHUNK_SIZE, length));
+        } else if (_chunks[_current].size() + length > _chunks[_current].capacity()) {
+            // Move to next chunk, records never cross chunks
+            if (++_current == _chunks.size()) {
+                _chunks.emplace_back();
+            }
+            _chunks[_current].reserve(MAX_VAL(ARENA_CHUNK_SIZE, length));
+        }
+
+        std::string & chunk = _chunks[_current];
+
+        entry_t e;
+        e.exact = v.sortPrefix(e.prefix) ? 1 : 0;
+        e.chunk = _current;
+        e.offset = chunk.size();
+        e.length = length;
+
+        chunk.append(_scratch);
+        _index.push_back(e);
+
+        return length + sizeof(entry_t);
+
+    }
+
+    // Number of records
+    template <typename DataType>
+    inline size_t RecordArena<DataType>::size() const {
+
+        return _index.size();
+
+    }
+
+    // Unpack i-th record in order of the index
+    template <typename DataType>
+    bool RecordArena<DataType>::get(size_t i, DataType & v) const {
+
+        const entry_t & e = _index[i];
+        const char * cur = _chunks[e.chunk].data() + e.offset;
+
+        return v.unpack(cur, cur + e.length);
+
+    }
+
+    // Sort records (recordOrder_t)
+    template <typename DataType>
+    void RecordArena<DataType>::sort() {
+
+        std::sort(_index.begin(), _index.end(), [this](const entry_t & l, const entry_t & r) {
+            if (l.prefix != r.prefix) {
+                return l.prefix < r.prefix;
+            }
+            // Equal keys are ordered further by a secondary sort
+            if (l.exact && recordOrder_t<DataType>::keyOnly) {
+                return false;
+            }
+            this->unpackEntry(l, this->_left);
+            this->unpackEntry(r, this->_right);
+            return recordOrder_t<DataType>::less(this->_left, this->_right);
+        });
+
+    }
+
+    // Write records in order of the index
+    template <typename DataType>
+    bool RecordArena<DataType>::writeTo(BlockWriter<DataType> & os) const {
+
+        for (const entry_t & e: _index) {
+            if (!os.writePacked(_chunks[e.chunk].data() + e.offset, e.length, e.prefix)) {
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+    // Remove all records (memory of chunks is reused)
+    template <typename DataType>
+    void RecordArena<DataType>::clear() {
+
+        for (std::string & chunk: _chunks) {
+            chunk.clear();
+        }
+        _current = 0;
+        _index.clear();
+
+    }
+
+    // Exchange records with another arena
+    template <typename DataType>
+    void RecordArena<DataType>::swap(RecordArena<DataType> & o) {
+
+        _chunks.swap(o._chunks);
+        std::swap(_current, o._current);
+        _index.swap(o._index);
+
+    }
+}
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * Files of serialized records: binary job output, read back as input of later jobs with no parsing
+ * Layout: RECORD_FILE_MAGIC, then blocks (blockHeader_t and payload) as in temporary runs
+ */
+
+#ifndef RECORDFILE_H
+#define RECORDFILE_H
+
+#include <unistd.h>        // write, close
+#include <fcntl.h>         // open, O_xxx
+#include <errno.h>         // errno, EINTR
+#include <string.h>        // memcpy
+#include <stdint.h>        // uint32_t
+
+#include <string>          // string
+
+#include "def.hpp"         // RECORD_FILE_MAGIC, RECORD_BLOCK_SIZE, RUN_IO_BUFFER_SIZE,
+                           // MAX_RECORD_BLOCK_SIZE, BUFFER_SIZE, CODEC_NONE, E, I
+#include "compressor.hpp"  // blockHeader_t, encodeBlock, decodeBlock
+#include "metrics.hpp"     // codecMetrics_t
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    /*
+     * RecordFileWriter: records packed into blocks of RECORD_BLOCK_SIZE bytes, written to the
+     * file RUN_IO_BUFFER_SIZE bytes at once
+     */
+    template <typename DataType>
+    class RecordFileWriter {
+
+        protected:
+
+            // Descriptor of the file, -1 if not opened
+            int _fd;
+
+            // Codec of blocks
+            const uint32_t _codec;
+
+            // Compression metrics
+            codecMetrics_t * _metrics;
+
+            // Serialized records not encoded yet
+            std::string _block;
+
+            // Number of records in the block
+            uint32_t _count;
+
+            // Encoded blocks not written yet
+            std::string _encoded;
+
+            // Number of records written
+            size_t _records;
+
+            // Encode buffered records as a block
+            bool flushBlock();
+
+            // Write encoded blocks to file
+            bool flushEncoded();
+
+        public:
+
+            // Constructor
+            explicit RecordFileWriter(uint32_t codec = CODEC_NONE,
+                                      codecMetrics_t * metrics = nullptr);
+
+            // Copy constructor (deleted)
+            RecordFileWriter(const RecordFileWriter<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            RecordFileWriter<DataType> & operator = (const RecordFileWriter<DataType> &) = delete;
+
+            // Destructor
+            ~RecordFileWriter();
+
+            // Create (or truncate) file at path and write its magic
+            bool open(const char * path);
+
+            // Write a record
+            bool write(const DataType & v);
+
+            // Flush and close the file
+            bool close();
+
+            // Number of records written
+            size_t records() const;
+    };
+
+    /*
+     * SplitReader: records of a split of a record file (whole blocks, as Splitter hands them
+     * out), for a mapper of a job whose input is binary output of another job
+     */
+    template <typename DataType>
+    class SplitReader {
+
+        protected:
+
+            // Split it reads
+            const std::string & _split;
+
+            // Offset of the next block in split
+            size_t _offset;
+
+            // Compression metrics
+            codecMetrics_t * _metrics;
+
+            // Serialized records of the current block
+            std::string _raw;
+
+            // Next record in _raw
+            const char * _cursor;
+
+            // Records left in the current block
+            uint32_t _remain;
+
+            // Decode next block
+            bool readBlock();
+
+        public:
+
+            // Constructor
+            explicit SplitReader(const std::string & split, codecMetrics_t * metrics = nullptr);
+
+            // Copy constructor (deleted)
+            SplitReader(const SplitReader<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            SplitReader<DataType> & operator = (const SplitReader<DataType> &) = delete;
+
+            // Read a record, false if the split ends or is corrupted
+            bool read(DataType & v);
+    };
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Encode buffered records as a block
+    template <typename DataType>
+    bool RecordFileWriter<DataType>::flushBlock() {
+
+        if (_count == 0) {
+            return true;
+        }
+
+        encodeBlock(_block, _count, _codec, _encoded, _metrics);
+        _block.clear();
+        _count = 0;
+
+        if (_encoded.size() >= RUN_IO_BUFFER_SIZE) {
+            return flushEncoded();
+        }
+
+        return true;
+
+    }
+
+    // Write encoded blocks to file
+    template <typename DataType>
+    bool RecordFileWriter<DataType>::flushEncoded() {
+
+        const char * data = _encoded.data();
+        size_t length = _encoded.size();
+
+        while (length != 0) {
+            ssize_t written = ::write(_fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                E("(RecordFileWriter) Fail to write to record file.");
+                I("Check if there is no space.");
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+
+        _encoded.clear();
+
+        return true;
+
+    }
+
+    // Constructor
+    template <typename DataType>
+    RecordFileWriter<DataType>::RecordFileWriter(uint32_t codec, codecMetrics_t * metrics)
+    : _fd{-1}, _codec{codec}, _metrics{metrics}, _count{0}, _records{0} {}
+
+    // Destructor
+    template <typename DataType>
+    RecordFileWriter<DataType>::~RecordFileWriter() {
+
+        close();
+
+    }
+
+    // Create (or truncate) file at path and write its magic
+    template <typename DataType>
+    bool RecordFileWriter<DataType>::open(const char * path) {
+
+        close();
+
+        _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (_fd == -1) {
+            E("(RecordFileWriter) Fail to open file to write.");
+            I("Check if there is no space.");
+            return false;
+        }
+
+        _block.reserve(RECORD_BLOCK_SIZE + BUFFER_SIZE);
+        _encoded.reserve(RUN_IO_BUFFER_SIZE + 2 * RECORD_BLOCK_SIZE);
+        _encoded.assign(RECORD_FILE_MAGIC, LENGTH_CONST_CHAR_ARRAY(RECORD_FILE_MAGIC));
+        _records = 0;
+
+        return true;
+
+    }
+
+    // Write a record
+    template <typename DataType>
+    inline bool RecordFileWriter<DataType>::write(const DataType & v) {
+
+        v.pack(_block);
+        ++_count;
+        ++_records;
+
+        if (_block.size() >= RECORD_BLOCK_SIZE) {
+            return flushBlock();
+        }
+
+        return true;
+
+    }
+
+    // Flush and close the file
+    template <typename DataType>
+    bool RecordFileWriter<DataType>::close() {
+
+        if (_fd == -1) {
+            return true;
+        }
+
+        bool ret = flushBlock();
+
+        ret = flushEncoded() && ret;
+        ret = (::close(_fd) == 0) && ret;
+        _fd = -1;
+        _block.clear();
+        _encoded.clear();
+        _count = 0;
+
+        return ret;
+
+    }
+
+    // Number of records written
+    template <typename DataType>
+    inline size_t RecordFileWriter<DataType>::records() const {
+
+        return _records;
+
+    }
+
+    // Decode next block
+    template <typename DataType>
+    bool SplitReader<DataType>::readBlock() {
+
+        blockHeader_t header;
+
+        do {
+            if (_offset + sizeof(blockHeader_t) > _split.size()) {
+                return false;
+            }
+
+            memcpy(&header, _split.data() + _offset, sizeof(blockHeader_t));
+            _offset += sizeof(blockHeader_t);
+
+            if (header.storedLength > _split.size() - _offset ||
+                header.rawLength > MAX_RECORD_BLOCK_SIZE) {
+                E("(SplitReader) Corrupted block header.");
+                _offset = _split.size();
+                return false;
+            }
+
+            if (!decodeBlock(header, _split.data() + _offset, _raw, _metrics)) {
+                _offset = _split.size();
+                return false;
+            }
+            _offset += header.storedLength;
+        } while (header.count == 0);
+
+        _cursor = _raw.data();
+        _remain = header.count;
+
+        return true;
+
+    }
+
+    // Constructor
+    template <typename DataType>
+    SplitReader<DataType>::SplitReader(const std::string & split, codecMetrics_t * metrics)
+    : _split(split), _offset{0}, _metrics{metrics}, _cursor{nullptr}, _remain{0} {}
+
+    // Read a record, false if the split ends or is corrupted
+    template <typename DataType>
+    bool SplitReader<DataType>::read(DataType & v) {
+
+        if (_remain == 0 && !readBlock()) {
+            return false;
+        }
+
+        if (!v.unpack(_cursor, _raw.data() + _raw.size())) {
+            E("(SplitReader) Corrupted record.");
+            _remain = 0;
+            _offset = _split.size();
+            return false;
+        }
+        --_remain;
+
+        return true;
+
+    }
+}
+
+#endif
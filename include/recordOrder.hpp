@@ -0,0 +1,77 @@
+/*
+ * Order records are sorted and merged in, equality records are grouped by for reduce, and how
+ * records of a key are combined by hash aggregation
+ * A job specializes the traits (before its mapper and reducer) for a secondary sort or its own
+ * aggregate
+ */
+
+#ifndef RECORDORDER_H
+#define RECORDORDER_H
+
+#include "type.hpp" // Tuple
+
+namespace ch {
+
+    /*
+     * recordOrder_t: sort order of records, by operator < (the key) unless specialized,
+     * a specialized less must still order by key first (partitions and prefixes are by key)
+     * keyOnly is false if less also looks beyond what operator < compares, so that radix sort
+     * by key and equal key prefixes no longer decide the order
+     */
+    template <typename DataType>
+    struct recordOrder_t {
+        static const bool keyOnly = true;
+        static bool less(const DataType & l, const DataType & r) {
+            return l < r;
+        }
+    };
+
+    /*
+     * recordGroup_t: records of a reduce group, by operator == (the key) unless specialized
+     */
+    template <typename DataType>
+    struct recordGroup_t {
+        static bool equal(const DataType & l, const DataType & r) {
+            return l == r;
+        }
+    };
+
+    /*
+     * recordCombine_t: fold record v into into, a record of the same group, when records are
+     * aggregated by hash (REDUCE_HASH); the key of into must not change
+     * Not defined unless the job specializes it, as only the job knows its reducer
+     */
+    template <typename DataType>
+    struct recordCombine_t {
+        static const bool defined = false;
+        static void combine(DataType &, const DataType &) {}
+    };
+
+    /*
+     * sumValues_t: values of a key are added up (e.g. word counts)
+     * e.g. template <> struct recordCombine_t<Tuple<String, Integer> >
+     *          : public sumValues_t<Tuple<String, Integer> > {};
+     */
+    template <typename DataType>
+    struct sumValues_t {
+        static const bool defined = true;
+        static void combine(DataType & into, const DataType & v) {
+            into.second += v.second;
+        }
+    };
+
+    /*
+     * secondarySort_t: order of tuples by key, then by value
+     * e.g. template <> struct recordOrder_t<Tuple<String, Integer> >
+     *          : public secondarySort_t<Tuple<String, Integer> > {};
+     */
+    template <typename DataType>
+    struct secondarySort_t {
+        static const bool keyOnly = false;
+        static bool less(const DataType & l, const DataType & r) {
+            return (l.first < r.first) || (!(r.first < l.first) && l.second < r.second);
+        }
+    };
+}
+
+#endif
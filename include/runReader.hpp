@@ -0,0 +1,250 @@
+/*
+ * Readers of sorted (or unsorted) runs of records, in a segment store or in memory
+ */
+
+#ifndef RUNREADER_H
+#define RUNREADER_H
+
+#include <vector>          // vector
+#include <memory>          // shared_ptr
+
+#include "blockStream.hpp" // BlockReader
+#include "segmentStore.hpp" // SegmentStore
+#include "recordArena.hpp" // RecordArena
+#include "metrics.hpp"     // codecMetrics_t, memoryMetrics_t
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    /*
+     * RunReader: records of a run in order
+     */
+    template <typename DataType>
+    class RunReader {
+
+        public:
+
+            // Destructor
+            virtual ~RunReader() {}
+
+            // Read a record, false if the run ends
+            virtual bool read(DataType & v) = 0;
+    };
+
+    /*
+     * StoreRunReader: run in a segment store, removed from the store at destruction
+     */
+    template <typename DataType>
+    class StoreRunReader: public RunReader<DataType> {
+
+        protected:
+
+            // Store of the run
+            std::shared_ptr<SegmentStore> _store;
+
+            // Id of the run
+            size_t _run;
+
+            // Block stream of the run
+            BlockReader<DataType> _is;
+
+        public:
+
+            // Constructor: take run of store
+            StoreRunReader(const std::shared_ptr<SegmentStore> & store, size_t run,
+                           codecMetrics_t * metrics = nullptr);
+
+            // Copy constructor (deleted)
+            StoreRunReader(const StoreRunReader<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            StoreRunReader<DataType> & operator = (const StoreRunReader<DataType> &) = delete;
+
+            // Destructor
+            ~StoreRunReader();
+
+            // Read a record, false if the run ends
+            bool read(DataType & v);
+    };
+
+    /*
+     * MemoryRunReader: run of records on heap, released as they are read
+     */
+    template <typename DataType>
+    class MemoryRunReader: public RunReader<DataType> {
+
+        protected:
+
+            // Records it owns
+            std::vector<const DataType *> _data;
+
+            // Index of next record
+            size_t _next;
+
+            // Bytes of the records accounted in _memory (released at destruction)
+            memoryMetrics_t * _memory;
+            size_t _bytes;
+
+        public:
+
+            // Constructor: take records of data
+            MemoryRunReader(std::vector<const DataType *> & data, memoryMetrics_t * memory,
+                            size_t bytes);
+
+            // Copy constructor (deleted)
+            MemoryRunReader(const MemoryRunReader<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            MemoryRunReader<DataType> & operator = (const MemoryRunReader<DataType> &) = delete;
+
+            // Destructor
+            ~MemoryRunReader();
+
+            // Read a record, false if the run ends
+            bool read(DataType & v);
+    };
+
+    /*
+     * ArenaRunReader: run of records serialized in an arena, in order of its index
+     */
+    template <typename DataType>
+    class ArenaRunReader: public RunReader<DataType> {
+
+        protected:
+
+            // Records it owns
+            RecordArena<DataType> _arena;
+
+            // Index of next record
+            size_t _next;
+
+            // Bytes of the records accounted in _memory (released at destruction)
+            memoryMetrics_t * _memory;
+            size_t _bytes;
+
+        public:
+
+            // Constructor: take records of arena
+            ArenaRunReader(RecordArena<DataType> & arena, memoryMetrics_t * memory, size_t bytes);
+
+            // Copy constructor (deleted)
+            ArenaRunReader(const ArenaRunReader<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            ArenaRunReader<DataType> & operator = (const ArenaRunReader<DataType> &) = delete;
+
+            // Destructor
+            ~ArenaRunReader();
+
+            // Read a record, false if the run ends
+            bool read(DataType & v);
+    };
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Constructor: take run of store
+    template <typename DataType>
+    StoreRunReader<DataType>::StoreRunReader(const std::shared_ptr<SegmentStore> & store,
+                                             size_t run, codecMetrics_t * metrics)
+    : _store{store}, _run{run}, _is{metrics} {
+
+        _is.open(_store, _run);
+
+    }
+
+    // Destructor
+    template <typename DataType>
+    StoreRunReader<DataType>::~StoreRunReader() {
+
+        _is.close();
+        _store->removeRun(_run);
+
+    }
+
+    // Read a record, false if the run ends
+    template <typename DataType>
+    inline bool StoreRunReader<DataType>::read(DataType & v) {
+
+        return _is.read(v);
+
+    }
+
+    // Constructor: take records of data
+    template <typename DataType>
+    MemoryRunReader<DataType>::MemoryRunReader(std::vector<const DataType *> & data,
+                                               memoryMetrics_t * memory, size_t bytes)
+    : _next{0}, _memory{memory}, _bytes{bytes} {
+
+        _data.swap(data);
+
+    }
+
+    // Destructor
+    template <typename DataType>
+    MemoryRunReader<DataType>::~MemoryRunReader() {
+
+        for (; _next < _data.size(); ++_next) {
+            delete _data[_next];
+        }
+
+        if (_memory != nullptr) {
+            _memory->release(_bytes);
+        }
+
+    }
+
+    // Read a record, false if the run ends
+    template <typename DataType>
+    bool MemoryRunReader<DataType>::read(DataType & v) {
+
+        if (_next == _data.size()) {
+            return false;
+        }
+
+        v = std::move(*const_cast<DataType *>(_data[_next]));
+        delete _data[_next];
+        ++_next;
+
+        return true;
+
+    }
+
+    // Constructor: take records of arena
+    template <typename DataType>
+    ArenaRunReader<DataType>::ArenaRunReader(RecordArena<DataType> & arena,
+                                             memoryMetrics_t * memory, size_t bytes)
+    : _next{0}, _memory{memory}, _bytes{bytes} {
+
+        _arena.swap(arena);
+
+    }
+
+    // Destructor
+    template <typename DataType>
+    ArenaRunReader<DataType>::~ArenaRunReader() {
+
+        if (_memory != nullptr) {
+            _memory->release(_bytes);
+        }
+
+    }
+
+    // Read a record, false if the run ends
+    template <typename DataType>
+    bool ArenaRunReader<DataType>::read(DataType & v) {
+
+        if (_next == _arena.size()) {
+            return false;
+        }
+
+        return _arena.get(_next++, v);
+
+    }
+}
+
+#endif
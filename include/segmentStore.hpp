@@ -0,0 +1,121 @@
+/*
+ * One preallocated file holding all temporary runs of a file manager as extents
+ */
+
+#ifndef SEGMENTSTORE_H
+#define SEGMENTSTORE_H
+
+#include <stdint.h> // uint64_t
+
+#include <string>   // string
+#include <vector>   // vector
+#include <map>      // map
+#include <mutex>    // mutex
+#include <memory>   // unique_ptr
+#include <future>   // future
+
+#include "threadPool.hpp" // ThreadPool
+#include "def.hpp"        // READ_AHEAD_THREADS, SEGMENT_READ_ERROR
+
+namespace ch {
+
+    /*
+     * extent_t: contiguous bytes of the store file
+     */
+    struct extent_t {
+        uint64_t offset; // offset in the store file
+        uint64_t length; // length in bytes
+    };
+
+    /*
+     * SegmentStore: runs are appended to one file created on first use (and unlinked at once,
+     * so it is removed when closed), a catalogue maps each run to its extents in order
+     * Space of removed runs stays allocated and is reused by later appends
+     */
+    class SegmentStore {
+
+        protected:
+
+            // Directory of the store file
+            const std::string _dir;
+
+            // Store file, -1 till the first append
+            int _fd;
+
+            // End of used space
+            uint64_t _tail;
+
+            // Bytes preallocated
+            uint64_t _allocated;
+
+            // Space of removed runs before _tail, sorted by offset
+            std::vector<extent_t> _free;
+
+            // Run catalogue: extents of each run
+            std::map<size_t, std::vector<extent_t> > _catalogue;
+
+            // Id of next run
+            size_t _nextRun;
+
+            // Lock of the state above
+            std::mutex _lock;
+
+            // Number of I/O threads of read-ahead
+            const size_t _ioThreads;
+
+            // I/O threads of read-ahead, started by the first request
+            std::unique_ptr<ThreadPool> _ioPool;
+
+            // Create the store file if it does not exist
+            bool create();
+
+            // Find length bytes of space, from removed runs first
+            bool reserve(uint64_t length, uint64_t & offset);
+
+            // Give space back, coalesced with its neighbours
+            void release(const extent_t & extent);
+
+        public:
+
+            // Constructor: store file in dir, ioThreads reading runs ahead (one per reader
+            // expected to read at the same time)
+            explicit SegmentStore(const std::string & dir,
+                                  size_t ioThreads = READ_AHEAD_THREADS);
+
+            // Copy constructor (deleted)
+            SegmentStore(const SegmentStore &) = delete;
+
+            // Copy assignment (deleted)
+            SegmentStore & operator = (const SegmentStore &) = delete;
+
+            // Destructor
+            ~SegmentStore();
+
+            // Create an empty run, returns its id
+            size_t createRun();
+
+            // Append bytes to a run
+            bool append(size_t run, const char * data, size_t length);
+
+            // Read up to length bytes at offset of a run, returns bytes read (0 at the end,
+            // SEGMENT_READ_ERROR if the run is unknown or reading fails)
+            size_t read(size_t run, uint64_t offset, char * data, size_t length);
+
+            // Read as read does on an I/O thread, data must stay valid till the result is got
+            std::future<size_t> readAhead(size_t run, uint64_t offset, char * data, size_t length);
+
+            // Remove a run, its space is reused
+            void removeRun(size_t run);
+
+            // Bytes of a run
+            uint64_t runSize(size_t run);
+
+            // Number of runs in the catalogue
+            size_t runs();
+
+            // Bytes of the store file in use
+            uint64_t size();
+    };
+}
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ * Persistent connections between servers, multiplexing channels of jobs
+ */
+
+#ifndef SHUFFLEMESH_H
+#define SHUFFLEMESH_H
+
+#include <stdint.h>     // uint32_t
+
+#include <string>       // string
+#include <vector>       // vector
+#include <map>          // map
+#include <set>          // set
+#include <memory>       // shared_ptr
+#include <mutex>        // mutex
+#include <thread>       // thread
+#include <atomic>       // atomic_bool
+#include <chrono>       // steady_clock
+
+#include "def.hpp"      // STREAMMANAGER_PORT, INVALID_SOCKET
+
+namespace ch {
+
+    /*
+     * meshHeader_t: header of a frame on a mesh connection, followed by key and payload
+     */
+    struct meshHeader_t {
+        uint32_t kind;      // MESH_xxx
+        uint32_t keyLength; // length of channel key (IP of sender in hello)
+        uint32_t length;    // length of payload
+    };
+
+    /*
+     * ShuffleMesh: one long-lived connection per peer, owned by the server
+     * Jobs open logical channels, each one is a local socket pair whose
+     * other end is forwarded to the same channel on the peer
+     */
+    class ShuffleMesh {
+
+        protected:
+
+            /*
+             * Connection to a peer
+             */
+            struct peer_t {
+                int fd;              // non-blocking socket
+                std::string ip;      // advertised IP, empty till hello received
+                std::string in;      // bytes received but not parsed
+                std::string out;     // frames not sent completely
+                size_t sent;         // bytes of out already sent
+
+                explicit peer_t(int sockfd): fd{sockfd}, sent{0} {}
+            };
+
+            /*
+             * Logical channel of a job
+             */
+            struct channel_t {
+                int fd;              // mesh side of the socket pair, INVALID_SOCKET if not opened
+                std::string toLocal; // bytes from peer not written to fd completely
+                size_t written;      // bytes of toLocal already written
+                bool remoteClosed;   // peer closed the channel
+                bool shut;           // fd shut down for writing
+                std::chrono::steady_clock::time_point created; // reset if not opened in time
+
+                channel_t(): fd{INVALID_SOCKET}, written{0}, remoteClosed{false}, shut{false},
+                             created{std::chrono::steady_clock::now()} {}
+            };
+
+            typedef std::pair<std::string, std::string> channelKey_t; // (peer IP, key)
+
+            // Listening socket
+            int _serverfd;
+
+            // Port of all meshes
+            unsigned short _port;
+
+            // Pipe waking up the event loop
+            int _wakefd[2];
+
+            // IP of this machine advertised to peers
+            std::string _selfIP;
+
+            // Connections (accepted and connected)
+            std::vector<std::shared_ptr<peer_t> > _peers;
+
+            // Connection used to send to each IP
+            std::map<std::string, std::shared_ptr<peer_t> > _routes;
+
+            // Channels by peer and key
+            std::map<channelKey_t, std::shared_ptr<channel_t> > _channels;
+
+            // Channels closed locally, waiting for close of the peer
+            std::set<channelKey_t> _closed;
+
+            // Channels reset as no job opened them in time, they can not be opened any more
+            std::set<channelKey_t> _expired;
+
+            // Lock of the state above
+            std::mutex _lock;
+
+            // Serialize connecting to peers
+            std::mutex _connectLock;
+
+            // Event loop thread
+            std::thread * _loop;
+
+            // True if the event loop should run
+            std::atomic_bool _running;
+
+            // Wake up the event loop
+            void wake();
+
+            // Event loop: forward bytes between channels and peers
+            void eventLoop();
+
+            // Append a frame to the send buffer of a peer
+            static void appendFrame(peer_t & peer, uint32_t kind, const std::string & key,
+                                    const char * payload, size_t length);
+
+            // Parse frames received from a peer, false if a frame is corrupted
+            bool parseFrames(const std::shared_ptr<peer_t> & peer);
+
+            // Get channel receiving from a peer, nullptr if it is closed locally
+            channel_t * getChannel(const channelKey_t & key);
+
+            // Read from a peer, false if the connection is lost
+            bool readPeer(const std::shared_ptr<peer_t> & peer);
+
+            // Write pending frames to a peer, false if the connection is lost
+            static bool writePeer(peer_t & peer);
+
+            // Forward bytes written by the job to the peer, false if channel is closed by the job
+            bool readChannel(const channelKey_t & key, channel_t & channel);
+
+            // Write bytes from peer to the channel
+            static void writeChannel(channel_t & channel);
+
+            // Drop a lost connection, channels of its IP are closed
+            void dropPeer(const std::shared_ptr<peer_t> & peer);
+
+            // Reset channels peers send to that no job opened in MESH_OPEN_TIMEOUT seconds,
+            // true if some channel still waits to be opened
+            bool expireChannels();
+
+            // Get connection to an IP, connect if there is none
+            std::shared_ptr<peer_t> getRoute(const std::string & ip);
+
+        public:
+
+            // Default constructor
+            ShuffleMesh();
+
+            // Copy constructor (deleted)
+            ShuffleMesh(const ShuffleMesh &) = delete;
+
+            // Copy assignment (deleted)
+            ShuffleMesh & operator = (const ShuffleMesh &) = delete;
+
+            // Destructor
+            virtual ~ShuffleMesh();
+
+            // Accept peers at port and start the event loop
+            virtual bool start(unsigned short port = STREAMMANAGER_PORT);
+
+            // Stop the event loop and close all connections
+            virtual void stop();
+
+            // Open channel with key to peer at peerIP, fd is the local end
+            // the channel is closed by closing fd
+            virtual bool openChannel(const std::string & selfIP, const std::string & peerIP,
+                                     const std::string & key, int & fd);
+
+            // Forget channels of a finished job (keys start with jobName)
+            virtual void endJob(const std::string & jobName);
+    };
+}
+
+#endif
@@ -5,13 +5,11 @@
 #ifndef SORTEDSTREAM_H
 #define SORTEDSTREAM_H
 
-#include <unistd.h> // unlink
+#include <vector>          // vector
+#include <memory>          // unique_ptr
 
-#include <vector>   // vector
-#include <queue>    // priority_queue
-#include <string>   // string
-#include <fstream>  // ifstream
-#include <memory>   // shared_ptr
+#include "runReader.hpp"   // RunReader
+#include "recordOrder.hpp" // recordOrder_t
 
 namespace ch {
 
@@ -20,43 +18,47 @@ namespace ch {
     ********************************************/
 
     /*
-     * pairComparator: comparator template for pair
+     * SortedStream: k-way merge of sorted runs with a tournament (loser) tree
+     * Each internal node keeps the run that lost the match there, so replacing the winner
+     * takes one comparison per level on the path of its leaf; records stay in the run heads
      */
-    template <typename DataType_1, typename DataType_2, bool greater>
-    struct pairComparator {
-        bool operator()(const std::pair<DataType_1, DataType_2> & l,
-                        const std::pair<DataType_1, DataType_2> & r) {
-
-            if (greater) {
-                return l.first > r.first;
-            } else {
-                return l.first < r.first;
-            }
-
-        }
-    };
-
     template <typename DataType>
     class SortedStream {
 
         protected:
 
-            // Files it manages
-            std::vector<std::string> _files;
+            // Runs it merges, a run is released when it ends
+            std::vector<std::unique_ptr<RunReader<DataType> > > _runs;
+
+            // Current record of each run
+            std::vector<DataType> _heads;
 
-            // Min heap for streams
-            std::priority_queue<std::pair<DataType, std::shared_ptr<std::ifstream> >,
-                std::vector<std::pair<DataType, std::shared_ptr<std::ifstream> > >,
-                pairComparator<DataType, std::shared_ptr<std::ifstream>, true> > minHeap;
+            // True if the run has a current record
+            std::vector<bool> _live;
+
+            // Number of runs with a current record
+            size_t _active;
+
+            // Loser tree: _tree[0] is the winner, _tree[i] the loser at internal node i,
+            // leaf of run r is node r + number of runs
+            std::vector<size_t> _tree;
+
+            // True if _tree matches the runs
+            bool _built;
+
+            // True if run l should be taken before run r (ended runs are last)
+            bool before(size_t l, size_t r) const;
+
+            // Play all matches
+            void build();
+
+            // Replay the matches on the path of run r
+            void replay(size_t r);
 
         public:
 
             // Constructor
-            SortedStream(std::vector<std::string> && files);
-
-            // Constructor with iterator
-            template <typename FileIter_T>
-            SortedStream(const FileIter_T & begin, const FileIter_T & end);
+            SortedStream();
 
             // Copy constructor (deleted)
             SortedStream(const SortedStream<DataType> & ) = delete;
@@ -70,12 +72,15 @@ namespace ch {
             // Move assignment
             SortedStream<DataType> & operator = (SortedStream<DataType> && o);
 
-            // Destructor
-            ~SortedStream();
+            // Merge a sorted run with the others, the stream owns it
+            void addRun(RunReader<DataType> * run);
 
             // True if the stream has data
             bool isValid() const;
 
+            // Next record without taking it, nullptr if the stream ends
+            const DataType * peek();
+
             // Get data from stream
             bool get(DataType & ret);
     };
@@ -84,59 +89,82 @@ namespace ch {
      ************ Implementation ****************
     ********************************************/
 
-    // Constructor
+    // True if run l should be taken before run r (ended runs are last)
     template <typename DataType>
-    SortedStream<DataType>::SortedStream(std::vector<std::string> && files)
-    : _files{std::move(files)} {
+    inline bool SortedStream<DataType>::before(size_t l, size_t r) const {
 
-        files.clear();
-        DataType temp;
+        if (!_live[l]) {
+            return false;
+        }
+        if (!_live[r]) {
+            return true;
+        }
 
-        for (const std::string & file: _files) {
-            std::shared_ptr<std::ifstream> is{new std::ifstream{file}};
-            if ((*is) && ((*is) >> temp)) {
-                minHeap.push(std::make_pair<DataType, std::shared_ptr<std::ifstream> >
-                                (
-                                    std::move(temp),
-                                    std::move(is)
-                                )
-                            );
+        return recordOrder_t<DataType>::less(_heads[l], _heads[r]);
+
+    }
+
+    // Play all matches
+    template <typename DataType>
+    void SortedStream<DataType>::build() {
+
+        const size_t k = _runs.size();
+
+        // Winner of each node, leaves are the runs
+        std::vector<size_t> winners(2 * k);
+
+        _tree.assign(MAX_VAL(k, 1), 0);
+
+        for (size_t r = 0; r < k; ++r) {
+            winners[k + r] = r;
+        }
+
+        for (size_t n = k - 1; n > 0; --n) {
+            const size_t l = winners[2 * n];
+            const size_t r = winners[2 * n + 1];
+
+            if (before(r, l)) {
+                winners[n] = r;
+                _tree[n] = l;
+            } else {
+                winners[n] = l;
+                _tree[n] = r;
             }
         }
 
+        _tree[0] = (k > 1) ? winners[1] : 0;
+        _built = true;
+
     }
 
-    // Constructor with iterator
+    // Replay the matches on the path of run r
     template <typename DataType>
-    template <typename FileIter_T>
-    SortedStream<DataType>::SortedStream(const FileIter_T & begin, const FileIter_T & end) {
+    inline void SortedStream<DataType>::replay(size_t r) {
 
-        DataType temp;
-        FileIter_T it = begin;
-
-        while (it < end) {
-            std::shared_ptr<std::ifstream> is{new std::ifstream{*it}};
-            _files.push_back(std::move(*it));
-            if ((*is) && ((*is) >> temp)) {
-                minHeap.push(std::make_pair<DataType, std::shared_ptr<std::ifstream> >
-                                (
-                                    std::move(temp),
-                                    std::move(is)
-                                )
-                            );
+        size_t winner = r;
+
+        for (size_t n = (r + _runs.size()) / 2; n > 0; n /= 2) {
+            if (before(_tree[n], winner)) {
+                std::swap(_tree[n], winner);
             }
-            ++it;
         }
 
+        _tree[0] = winner;
+
     }
 
+    // Constructor
+    template <typename DataType>
+    SortedStream<DataType>::SortedStream(): _active{0}, _built{false} {}
+
     // Move constructor
     template <typename DataType>
     SortedStream<DataType>::SortedStream(SortedStream<DataType> && o)
-    : _files{std::move(o._files)} {
+    : _runs{std::move(o._runs)}, _heads{std::move(o._heads)}, _live{std::move(o._live)},
+      _active{o._active}, _tree{std::move(o._tree)}, _built{o._built} {
 
-        o._files.clear();
-        o.minHeap.swap(minHeap);
+        o._active = 0;
+        o._built = false;
 
     }
 
@@ -144,31 +172,61 @@ namespace ch {
     template <typename DataType>
     SortedStream<DataType> & SortedStream<DataType>::operator = (SortedStream<DataType> && o) {
 
-        _files = std::move(o._files);
-        o.minHeap.swap(minHeap);
+        _runs = std::move(o._runs);
+        _heads = std::move(o._heads);
+        _live = std::move(o._live);
+        _active = o._active;
+        _tree = std::move(o._tree);
+        _built = o._built;
+
+        o._active = 0;
+        o._built = false;
+
         return *this;
 
     }
 
-    // Destructor
+    // Merge a sorted run with the others, the stream owns it
     template <typename DataType>
-    SortedStream<DataType>::~SortedStream() {
+    void SortedStream<DataType>::addRun(RunReader<DataType> * run) {
 
-        while (!minHeap.empty()) {
-            minHeap.pop();
-        }
+        std::unique_ptr<RunReader<DataType> > holder{run};
+        DataType temp;
 
-        for (const std::string & file: _files) {
-            unlink(file.c_str());
+        // Empty runs are dropped at once
+        if (!holder->read(temp)) {
+            return;
         }
 
+        _runs.push_back(std::move(holder));
+        _heads.push_back(std::move(temp));
+        _live.push_back(true);
+        ++_active;
+        _built = false;
+
     }
 
     // True if the stream has data
     template <typename DataType>
     inline bool SortedStream<DataType>::isValid() const {
 
-        return (minHeap.size() != 0);
+        return (_active != 0);
+
+    }
+
+    // Next record without taking it, nullptr if the stream ends
+    template <typename DataType>
+    const DataType * SortedStream<DataType>::peek() {
+
+        if (!isValid()) {
+            return nullptr;
+        }
+
+        if (!_built) {
+            build();
+        }
+
+        return &(_heads[_tree[0]]);
 
     }
 
@@ -180,14 +238,23 @@ namespace ch {
             return false;
         }
 
-        std::pair<DataType, std::shared_ptr<std::ifstream> > top{std::move(minHeap.top())};
-        minHeap.pop();
-        ret = std::move(top.first);
+        if (!_built) {
+            build();
+        }
 
-        if((*(top.second)) >> top.first) {
-            minHeap.push(std::move(top));
+        const size_t r = _tree[0];
+
+        ret = std::move(_heads[r]);
+
+        if (!_runs[r]->read(_heads[r])) {
+            // Release the run (and its buffers) as soon as it ends
+            _runs[r].reset();
+            _live[r] = false;
+            --_active;
         }
 
+        replay(r);
+
         return true;
 
     }
@@ -0,0 +1,285 @@
+/*
+ * Sort records of a spill: radix sort for Integer/String keys, comparison sort otherwise,
+ * chunks sorted and merged on multiple threads
+ */
+
+#ifndef SORTER_H
+#define SORTER_H
+
+#include <stdint.h>     // uint32_t
+
+#include <vector>       // vector
+#include <string>       // string
+#include <thread>       // thread
+#include <algorithm>    // sort, inplace_merge
+#include <type_traits>  // integral_constant
+
+#include "def.hpp"         // SORT_xxx, PARALLEL_SORT_MIN, RADIX_SORT_MIN, MSD_RADIX_MAX_LEVEL
+#include "type.hpp"        // Integer, String, Tuple
+#include "recordOrder.hpp" // recordOrder_t
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    /*
+     * sortKey_t: how records of a type are sorted, kind is SORT_xxx
+     * get returns the key radix sort works on (not defined for SORT_COMPARE)
+     */
+    template <typename DataType>
+    struct sortKey_t {
+        static const int kind = SORT_COMPARE;
+    };
+
+    template <>
+    struct sortKey_t<Integer> {
+        static const int kind = SORT_INTEGER;
+        static int get(const Integer & v) {
+            return v.value;
+        }
+    };
+
+    template <>
+    struct sortKey_t<String> {
+        static const int kind = SORT_STRING;
+        static const std::string & get(const String & v) {
+            return v.value;
+        }
+    };
+
+    template <typename DataType_1, typename DataType_2>
+    struct sortKey_t<Tuple<DataType_1, DataType_2> > {
+        static const int kind = sortKey_t<DataType_1>::kind;
+        static auto get(const Tuple<DataType_1, DataType_2> & v)
+        -> decltype(sortKey_t<DataType_1>::get(v.first)) {
+            return sortKey_t<DataType_1>::get(v.first);
+        }
+    };
+
+    // Sort pointers to records by the records (recordOrder_t), on up to threads threads
+    // (0: all cores)
+    template <typename DataType>
+    void sortRecords(std::vector<const DataType *> & data, size_t threads = 0);
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Dereference pointer and compare
+    template <typename DataType>
+    inline bool recordPointerLess(const DataType * l, const DataType * r) {
+
+        return recordOrder_t<DataType>::less(*l, *r);
+
+    }
+
+    // Integer key as unsigned, in the same order
+    template <typename DataType>
+    inline uint32_t integerRadix(const DataType * v) {
+
+        return static_cast<uint32_t>(sortKey_t<DataType>::get(*v)) ^ 0x80000000u;
+
+    }
+
+    // Bucket of String key by byte at depth: 0 if the key ends before, else byte + 1
+    template <typename DataType>
+    inline size_t stringRadix(const DataType * v, size_t depth) {
+
+        const std::string & key = sortKey_t<DataType>::get(*v);
+
+        return (depth < key.size()) ? static_cast<unsigned char>(key[depth]) + 1 : 0;
+
+    }
+
+    // Comparison sort
+    template <typename DataType>
+    void sortRange(const DataType ** begin, const DataType ** end,
+                   std::integral_constant<int, SORT_COMPARE>) {
+
+        std::sort(begin, end, recordPointerLess<DataType>);
+
+    }
+
+    // LSD radix sort by Integer key, a byte per pass
+    template <typename DataType>
+    void sortRange(const DataType ** begin, const DataType ** end,
+                   std::integral_constant<int, SORT_INTEGER>) {
+
+        const size_t n = end - begin;
+
+        if (n < RADIX_SORT_MIN) {
+            std::sort(begin, end, recordPointerLess<DataType>);
+            return;
+        }
+
+        std::vector<const DataType *> buffer(n);
+        const DataType ** from = begin;
+        const DataType ** to = buffer.data();
+
+        for (uint32_t shift = 0; shift < 32; shift += 8) {
+            size_t count[256] = {0};
+
+            for (size_t i = 0; i < n; ++i) {
+                ++count[(integerRadix(from[i]) >> shift) & 0xFF];
+            }
+
+            // All keys share the byte, nothing to move
+            if (count[(integerRadix(from[0]) >> shift) & 0xFF] == n) {
+                continue;
+            }
+
+            size_t offset = 0;
+            for (size_t b = 0; b < 256; ++b) {
+                const size_t c = count[b];
+                count[b] = offset;
+                offset += c;
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                to[count[(integerRadix(from[i]) >> shift) & 0xFF]++] = from[i];
+            }
+
+            std::swap(from, to);
+        }
+
+        if (from != begin) {
+            std::copy(from, from + n, begin);
+        }
+
+    }
+
+    // MSD radix sort by String key from byte depth on, keys of the range share depth bytes,
+    // level is the number of calls it is nested in
+    template <typename DataType>
+    void msdRadixSort(const DataType ** begin, const DataType ** end, size_t depth, size_t level,
+                      std::vector<const DataType *> & buffer) {
+
+        const size_t n = end - begin;
+
+        // Deep nesting (long keys differing late) is left to comparison, bounding the stack
+        if (n < RADIX_SORT_MIN || level >= MSD_RADIX_MAX_LEVEL) {
+            std::sort(begin, end, recordPointerLess<DataType>);
+            return;
+        }
+
+        size_t count[257];
+
+        // Bytes shared by all keys are skipped without nesting a call
+        while (true) {
+            std::fill(count, count + 257, 0);
+
+            for (size_t i = 0; i < n; ++i) {
+                ++count[stringRadix(begin[i], depth)];
+            }
+
+            const size_t first = stringRadix(begin[0], depth);
+
+            if (count[first] != n) {
+                break;
+            }
+            if (first == 0) { // All keys are equal
+                return;
+            }
+            ++depth;
+        }
+
+        size_t start[258];
+        start[0] = 0;
+        for (size_t b = 0; b < 257; ++b) {
+            start[b + 1] = start[b] + count[b];
+        }
+
+        buffer.resize(n);
+        size_t next[257];
+        std::copy(start, start + 257, next);
+
+        for (size_t i = 0; i < n; ++i) {
+            buffer[next[stringRadix(begin[i], depth)]++] = begin[i];
+        }
+
+        std::copy(buffer.begin(), buffer.begin() + n, begin);
+
+        // Keys of bucket 0 are equal, the others are sorted by the next byte
+        for (size_t b = 1; b < 257; ++b) {
+            if (count[b] > 1) {
+                msdRadixSort(begin + start[b], begin + start[b + 1], depth + 1, level + 1, buffer);
+            }
+        }
+
+    }
+
+    // MSD radix sort by String key
+    template <typename DataType>
+    void sortRange(const DataType ** begin, const DataType ** end,
+                   std::integral_constant<int, SORT_STRING>) {
+
+        std::vector<const DataType *> buffer;
+
+        msdRadixSort(begin, end, 0, 0, buffer);
+
+    }
+
+    // Sort pointers to records by the records (recordOrder_t), on up to threads threads
+    // (0: all cores)
+    template <typename DataType>
+    void sortRecords(std::vector<const DataType *> & data, size_t threads) {
+
+        // Radix sort orders by key only
+        typedef std::integral_constant<int, recordOrder_t<DataType>::keyOnly ?
+                                            sortKey_t<DataType>::kind : SORT_COMPARE> kind_t;
+
+        const size_t n = data.size();
+
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        threads = MIN_VAL(threads, n / PARALLEL_SORT_MIN);
+
+        if (threads <= 1) {
+            sortRange(data.data(), data.data() + n, kind_t());
+            return;
+        }
+
+        // Sort a chunk per thread
+        std::vector<size_t> bounds;
+        for (size_t i = 0; i <= threads; ++i) {
+            bounds.push_back(n * i / threads);
+        }
+
+        const DataType ** base = data.data();
+        std::vector<std::thread> workers;
+
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([base, &bounds, i](){
+                sortRange(base + bounds[i], base + bounds[i + 1], kind_t());
+            });
+        }
+        for (std::thread & worker: workers) {
+            worker.join();
+        }
+
+        // Merge neighbouring chunks in pairs, the pairs of a round in parallel
+        for (size_t width = 1; width < threads; width *= 2) {
+            workers.clear();
+
+            for (size_t i = 0; i + width < threads; i += 2 * width) {
+                const size_t first = bounds[i];
+                const size_t middle = bounds[i + width];
+                const size_t last = bounds[MIN_VAL(i + 2 * width, threads)];
+
+                workers.emplace_back([base, first, middle, last](){
+                    std::inplace_merge(base + first, base + middle, base + last,
+                                       recordPointerLess<DataType>);
+                });
+            }
+            for (std::thread & worker: workers) {
+                worker.join();
+            }
+        }
+
+    }
+}
+
+#endif
@@ -59,6 +59,12 @@ namespace ch {
             // Results from workers
             std::vector<bool> workerIsSuccess;
 
+            // Output manifests from workers (lines of files written by each worker)
+            std::vector<std::string> workerManifests;
+
+            // Receive result (and output manifest on success) of the ith worker
+            void receiveResult(const int sockfd, const size_t i);
+
             // Rearrange ipconfig to create configure files for other machines
             static void rearrangeIPs(const ipconfig_t & ips, std::string & file, const size_t indexToHead);
 
@@ -83,7 +89,9 @@ namespace ch {
             ~SourceManagerMaster();
 
             // Connect to workers and deliver files
-            bool connectAndDeliver(const ipconfig_t & ips, const std::string & jobName, unsigned short port = SERVER_PORT);
+            bool connectAndDeliver(const ipconfig_t & ips, const std::string & jobName,
+                                   const std::string & outputFilePath,
+                                   unsigned short port = SERVER_PORT);
 
             // Start distribution thread
             void startDistributionThread();
@@ -94,6 +102,9 @@ namespace ch {
             // True if all worker success
             bool allWorkerSuccess();
 
+            // Append output manifests of workers in order of their index
+            void appendWorkerManifests(std::string & manifest) const;
+
             bool isValid() const;
 
             bool poll(std::string & ret);
@@ -137,7 +148,9 @@ namespace ch {
             // Receive resource files
             // 1. Configuration file
             // 2. Job file
-            bool receiveFiles(std::string & confFilePath, std::string & jobFilePath, std::string & jobName, std::string & workingDir);
+            // 3. Output path
+            bool receiveFiles(std::string & confFilePath, std::string & jobFilePath, std::string & jobName,
+                              std::string & workingDir, std::string & outputFilePath);
 
             bool isValid() const;
 
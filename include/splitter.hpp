@@ -1,5 +1,6 @@
 /*
  * Splitter: buffer to get splits of data from file
+ * Text files are split at line ends, record files (binary output of a job) at block ends
  */
 
 #ifndef SPLITTER_H
@@ -8,10 +9,11 @@
 #include <stdio.h>   // FILE, fopen
 
 #include <mutex>     // mutex, lock_guard
-#include <string.h>  // memmove
+#include <string.h>  // memmove, memcmp
 
-#include "def.hpp"   // DATA_BLOCK_SIZE, IS_ESCAPER
-#include "utils.hpp" // pfread
+#include "def.hpp"        // DATA_BLOCK_SIZE, IS_ESCAPER, RECORD_FILE_MAGIC
+#include "utils.hpp"      // pfread
+#include "compressor.hpp" // blockHeader_t
 
 namespace ch {
 
@@ -31,6 +33,13 @@ namespace ch {
             // Number of bytes cached in buffer
             size_t bufferedLength;
 
+            // True if the file is a record file (starts with RECORD_FILE_MAGIC)
+            bool _records;
+
+            // Get next split of a record file: whole blocks of DATA_BLOCK_SIZE bytes at least,
+            // unless the file ends (magics of concatenated record files are skipped)
+            bool nextBlocks(std::string & res);
+
         public:
 
             // Default constructor
@@ -51,7 +60,7 @@ namespace ch {
             // Destructor
             ~Splitter();
 
-            // Open the file
+            // Open the file, a record file is detected by its magic
             bool open(const char * file);
 
             // True if the file is opened and there are data remain
@@ -13,19 +13,26 @@
 #include <atomic>           // atomic_xxx
 #include <vector>           // vector
 #include <string>           // string
-#include <fstream>          // ofstream
 #include <thread>           // thread, yield, sleep_for
 #include <chrono>           // seconds
 #include <memory>           // unique_ptr, std::addressof
 #include <unordered_map>    // unordered_map
+#include <mutex>            // mutex, lock_guard
+#include <random>           // minstd_rand
 
 #include "def.hpp"          // ipconfig_t, STREAMMANAGER_PORT, MAX_CONNECTION_ATTEMPT,
                             // select/epoll/kqueue headers
 #include "utils.hpp"        // receiveString, prepareServer, readIPs
 #include "objectStream.hpp" // ObjectInputStream, ObjectOutputStream
+#include "options.hpp"      // options_t
+#include "metrics.hpp"      // Metrics
 #include "dataManager.hpp"  // DataManager
-#include "partitioner.hpp"  // Partitioner
+#include "partitioner.hpp"  // Partitioner, RangePartitioner, HotKeys
 #include "threadPool.hpp"   // ThreadPool
+#include "shuffleMesh.hpp"  // ShuffleMesh
+#include "textWriter.hpp"   // TextWriter
+#include "recordFile.hpp"   // RecordFileWriter
+#include "murmur.hpp"       // murmur2
 
 namespace ch {
 
@@ -59,12 +66,82 @@ namespace ch {
             // Output streams
             std::vector<ObjectOutputStream<DataType> *> ostreams;
 
-            // Data manager
+            // Codec of blocks sent to other machines
+            const uint32_t _shuffleCodec;
+
+            // Blocks in flight per connection, 0 if flow control is disabled
+            const uint32_t _shuffleCredits;
+
+            // Bytes of blocks held in memory per connection for lack of credits
+            const size_t _maxDeferredSize;
+
+            // Directory of overflow files
+            const std::string _dir;
+
+            // Job metrics (nullable)
+            Metrics * _metrics;
+
+            // Data manager (bucket 0)
             DataManager<DataType> _data;
 
+            // Options of data managers of other buckets
+            const options_t _options;
+
+            // Buckets of local data besides _data, records are spread over buckets by hash
+            // so that buckets can be reduced in parallel
+            std::vector<std::unique_ptr<DataManager<DataType> > > _buckets;
+
+            // Number of buckets records are stored to
+            size_t _nBuckets;
+
             // Partitioner
             const Partitioner * _partitioner;
 
+            // Partitioner by key range, used instead of _partitioner if not nullptr
+            const RangePartitioner<DataType> * _rangePartitioner;
+
+            // True if pushed data are kept on this machine regardless of the partitioner
+            bool _localOutput;
+
+            // Hot keys, records of which are salted (sent round robin) if not nullptr
+            const HotKeys<DataType> * _hotKeys;
+
+            // Records of hot keys are pushed to it instead of salted if not nullptr
+            StreamManager<DataType> * _divert;
+
+            // Next machine to send salted records
+            std::atomic<size_t> _saltCursor;
+
+            // Persistent connections of the server (nullable)
+            ShuffleMesh * _mesh;
+
+            // Size of reservoir sample of pushed data, 0 if not sampling
+            size_t _sampleSize;
+
+            // Number of records seen by sampling
+            size_t _sampled;
+
+            // Reservoir sample of pushed data
+            std::vector<DataType> _samples;
+
+            // Random generator of sampling
+            std::minstd_rand _random;
+
+            // Lock of sampling (mappers may push concurrently)
+            std::mutex _sampleLock;
+
+            // Add a pushed record to the reservoir sample
+            void sample(const DataType & v);
+
+            // Get the data manager of a bucket
+            DataManager<DataType> & getBucket(size_t i);
+
+            // Get the bucket of a record on this machine
+            size_t getBucketIndex(DataType & v);
+
+            // Store data in its bucket on this machine
+            bool storeLocal(DataType & v);
+
             // Server thread: accept connections
             static void serverThread(int serverfd, const ipconfig_t & ips,
                                      std::vector<ObjectInputStream<DataType> *> & istreams,
@@ -79,21 +156,31 @@ namespace ch {
             // Close and clear all streams
             void clearStreams();
 
+            // Accept and connect to all machines through new connections
+            bool acceptAndConnect(const ipconfig_t & ips, const std::string & jobName);
+
+            // Open channels of the job on the shuffle mesh
+            bool openChannels(const ipconfig_t & ips, const std::string & jobName);
+
             // Initialize streams
-            // Accept and connect to all machines
+            // Accept and connect to all machines, or open channels if there is a mesh
             void establishConnection(const ipconfig_t & ips, const std::string & jobName);
 
         public:
 
             // Constructor: given directory of configuration
             StreamManager(const std::string & configureFile, const std::string & dir,
-                          const std::string & jobName, size_t maxDataSize = DEFAULT_MAX_DATA_SIZE,
-                          bool presort = true, const Partitioner & partitioner = hashPartitioner);
+                          const std::string & jobName, const options_t & options = options_t(),
+                          Metrics * metrics = nullptr, bool presort = true,
+                          const Partitioner & partitioner = hashPartitioner,
+                          ShuffleMesh * mesh = nullptr);
 
             // Constructor: given vector of IP configuration
             StreamManager(const ipconfig_t & ips, const std::string & dir,
-                          const std::string & jobName, size_t maxDataSize = DEFAULT_MAX_DATA_SIZE,
-                          bool presort = true, const Partitioner & partitioner = hashPartitioner);
+                          const std::string & jobName, const options_t & options = options_t(),
+                          Metrics * metrics = nullptr, bool presort = true,
+                          const Partitioner & partitioner = hashPartitioner,
+                          ShuffleMesh * mesh = nullptr);
 
             // Copy constructor (deleted)
             StreamManager(const StreamManager<DataType> &) = delete;
@@ -124,11 +211,13 @@ namespace ch {
             // Send stop signal to other machines, cause receive thread on other machines
             // to terminate and close connection
             // called when we don't need these connections anymore
-            void finalizeSend(void);
+            // false if data sent may not be received
+            bool finalizeSend(void);
 
             // Send stop signal to other machines, cause receive thread on other machines to terminate
             // called when we need to temporarily stop receiving (e.g. switch from map to reduce)
-            void stopSend(void);
+            // false if data sent may not be received
+            bool stopSend(void);
 
             // Cause the current thread to block until all receive thread end
             // and clear resource of receive threads
@@ -137,17 +226,63 @@ namespace ch {
             // Push data to the specific machine (partitioned by partitioner)
             bool push(DataType & v);
 
-            // Get sorted stream from data manager
+            // Push data to all machines (including this one)
+            bool pushAll(DataType & v);
+
+            // Get sorted stream from data manager (data must be in one bucket)
             SortedStream<DataType> * getSortedStream (void);
 
-            // Pour data to text file with temporary files in data manager
-            bool pourToTextFile (const char * path);
+            // Get sorted streams of all buckets (empty buckets are skipped)
+            void getSortedStreams (std::vector<std::unique_ptr<SortedStream<DataType> > > & sorteds);
+
+            // Get unsorted stream from data manager
+            UnsortedStream<DataType> * getUnsortedStream (void);
+
+            // Pour data to text file with temporary files in data manager, a line per record in
+            // style (TEXT_xxx), records is set to number of lines written if not nullptr
+            bool pourToTextFile (const char * path, size_t * records = nullptr,
+                                 uint32_t style = TEXT_REPR);
+
+            // Pour data to record file (blocks of serialized records in codec) with temporary
+            // files in data manager, records is set to number of records written if not nullptr
+            bool pourToRecordFile (const char * path, size_t * records = nullptr,
+                                   uint32_t codec = CODEC_NONE);
 
             // Set presort of data manager
+            // unsorted data are stored in one bucket
             void setPresort(bool presort);
 
+            // Spread sorted data over k buckets on this machine (set before data are stored)
+            void setBuckets(size_t k);
+
+            // Combine records by key as they are stored instead of sorting them, each sorted
+            // stream then holds one record per key in no order (set after buckets)
+            void setAggregate(bool aggregate);
+
             // Set partitioner
             void setPartitioner(const Partitioner & partitioner);
+
+            // Set partitioner by key range (must live till pushing ends)
+            void setPartitioner(const RangePartitioner<DataType> & partitioner);
+
+            // Keep a reservoir sample of size records pushed from now on
+            void setSampling(size_t size);
+
+            // Move the sample out
+            void getSamples(std::vector<DataType> & samples);
+
+            // Number of records seen by sampling
+            size_t sampledRecords();
+
+            // Salt records of hot keys, or push them to divert if it is not nullptr
+            // (hot keys and divert must live till pushing ends)
+            void setHotKeys(const HotKeys<DataType> * hotKeys, StreamManager<DataType> * divert = nullptr);
+
+            // Number of records stored on this machine since data were last got as a stream
+            size_t storedRecords();
+
+            // Keep pushed data on this machine (e.g. reducer output written to local part files)
+            void setLocalOutput(bool localOutput);
     };
 
     /********************************************
@@ -330,24 +465,16 @@ namespace ch {
 
     }
 
-    // Initialize streams
-    // Accept and connect to all machines
+    // Accept and connect to all machines through new connections
     template <typename DataType>
-    void StreamManager<DataType>::establishConnection(const ipconfig_t & ips,
-                                                      const std::string & jobName){
-
-        selfId = ips[0].first;
-
-        if (clusterSize < 2) {
-            connected = true;
-            return;
-        }
+    bool StreamManager<DataType>::acceptAndConnect(const ipconfig_t & ips,
+                                                   const std::string & jobName) {
 
         int serverfd;
 
         if (!prepareServer(serverfd, STREAMMANAGER_PORT)) {
             E("(StreamManager) Fail to open socket to accept clients.");
-            return;
+            return false;
         }
 
         istreams.clear();
@@ -377,7 +504,7 @@ namespace ch {
             if (i != selfId && ostreams[i] == nullptr) {
                 E("(StreamManager) One or more of connections are fail.");
                 clearStreams();
-                return;
+                return false;
             }
         }
 
@@ -385,9 +512,92 @@ namespace ch {
         if (istreams.size() != clusterSize - 1) {
             E("(StreamManager) Failed to accept all connections.");
             clearStreams();
+            return false;
+        }
+
+        return true;
+
+    }
+
+    // Open channels of the job on the shuffle mesh
+    template <typename DataType>
+    bool StreamManager<DataType>::openChannels(const ipconfig_t & ips,
+                                               const std::string & jobName) {
+
+        istreams.clear();
+        istreams.reserve(clusterSize - 1);
+        connections.clear();
+        connections.reserve(clusterSize - 1);
+        ostreams.clear();
+        ostreams.resize(clusterSize, nullptr);
+
+        const std::string & selfIP = ips[0].second;
+
+        // One channel per direction, key: job/sender>receiver
+        for (size_t i = 1; i < clusterSize; ++i) {
+            const size_t peerId = ips[i].first;
+            const std::string & peerIP = ips[i].second;
+            int fd;
+
+            if (!_mesh->openChannel(selfIP, peerIP, jobName + "/" + std::to_string(selfId) + ">" +
+                                    std::to_string(peerId), fd)) {
+                return false;
+            }
+            ostreams[peerId] = new ObjectOutputStream<DataType>{fd};
+
+            if (!_mesh->openChannel(selfIP, peerIP, jobName + "/" + std::to_string(peerId) + ">" +
+                                    std::to_string(selfId), fd)) {
+                return false;
+            }
+            connections.push_back(fd);
+            istreams.push_back(new ObjectInputStream<DataType>{fd});
+        }
+
+        return true;
+
+    }
+
+    // Initialize streams
+    // Accept and connect to all machines, or open channels if there is a mesh
+    template <typename DataType>
+    void StreamManager<DataType>::establishConnection(const ipconfig_t & ips,
+                                                      const std::string & jobName){
+
+        selfId = ips[0].first;
+
+        if (clusterSize < 2) {
+            connected = true;
+            return;
+        }
+
+        if (_mesh != nullptr) {
+            if (!openChannels(ips, jobName)) {
+                E("(StreamManager) Fail to open channels on shuffle mesh.");
+                clearStreams();
+                return;
+            }
+        } else if (!acceptAndConnect(ips, jobName)) {
             return;
         }
 
+        // Blocks are compressed by sender, codec is carried by each block
+        codecMetrics_t * shuffleMetrics = (_metrics == nullptr) ? nullptr : &(_metrics->shuffle);
+
+        // Receivers grant credits of consumed blocks, senders hold back blocks
+        // instead of blocking on a slow receiver
+        flowMetrics_t * flowMetrics = (_metrics == nullptr) ? nullptr : &(_metrics->flow);
+
+        for (ObjectOutputStream<DataType> * stm: ostreams) {
+            if (stm != nullptr) {
+                stm->setCompression(_shuffleCodec, shuffleMetrics);
+                stm->setFlowControl(_shuffleCredits, _maxDeferredSize, _dir, flowMetrics);
+            }
+        }
+        for (ObjectInputStream<DataType> * stm: istreams) {
+            stm->setMetrics(shuffleMetrics);
+            stm->setFlowControl(_shuffleCredits > 0);
+        }
+
         connected = true;
 
         P("(StreamManager) Connection set up successfully.");
@@ -399,10 +609,15 @@ namespace ch {
     StreamManager<DataType>::StreamManager(const std::string & configureFile,
                                            const std::string & dir,
                                            const std::string & jobName,
-                                           size_t maxDataSize, bool presort,
-                                           const Partitioner & partitioner)
-    : connected{false}, receiveThread{nullptr}, _data{dir, maxDataSize, presort},
-      _partitioner{&partitioner} {
+                                           const options_t & options, Metrics * metrics,
+                                           bool presort, const Partitioner & partitioner,
+                                           ShuffleMesh * mesh)
+    : connected{false}, receiveThread{nullptr}, _shuffleCodec{options.shuffleCodec},
+      _shuffleCredits{options.shuffleCredits}, _maxDeferredSize{options.maxDeferredSize},
+      _dir{dir}, _metrics{metrics}, _data{dir, options, metrics, presort},
+      _options(options), _nBuckets{1}, _partitioner{&partitioner},
+      _rangePartitioner{nullptr}, _localOutput{false}, _hotKeys{nullptr},
+      _divert{nullptr}, _saltCursor{0}, _mesh{mesh}, _sampleSize{0}, _sampled{0} {
 
         ipconfig_t ips;
 
@@ -425,11 +640,18 @@ namespace ch {
     StreamManager<DataType>::StreamManager(const ipconfig_t & ips,
                                            const std::string & dir,
                                            const std::string & jobName,
-                                           size_t maxDataSize,
+                                           const options_t & options,
+                                           Metrics * metrics,
                                            bool presort,
-                                           const Partitioner & partitioner)
+                                           const Partitioner & partitioner,
+                                           ShuffleMesh * mesh)
     : clusterSize{ips.size()}, connected{false}, receiveThread{nullptr},
-      _data{dir, maxDataSize, presort}, _partitioner{&partitioner} {
+      _shuffleCodec{options.shuffleCodec}, _shuffleCredits{options.shuffleCredits},
+      _maxDeferredSize{options.maxDeferredSize}, _dir{dir}, _metrics{metrics},
+      _data{dir, options, metrics, presort},
+      _options(options), _nBuckets{1}, _partitioner{&partitioner},
+      _rangePartitioner{nullptr}, _localOutput{false}, _hotKeys{nullptr},
+      _divert{nullptr}, _saltCursor{0}, _mesh{mesh}, _sampleSize{0}, _sampled{0} {
 
         if (clusterSize > 0) {
             establishConnection(ips, jobName);
@@ -486,12 +708,13 @@ namespace ch {
                 if (nWorker == 0) {
                     return;
                 } else if (nWorker == 1) {
-                    const ObjectInputStream<DataType> * stm = this->istreams[0];
+                    ObjectInputStream<DataType> * stm = this->istreams[0];
 
-                    DataType * got = nullptr;
+                    // Records are unpacked into the same one, data managers copy what they keep
+                    DataType got;
 
-                    while ((got = stm->recv())) {
-                        if (!(this->_data.store(got))) {
+                    while (stm->recv(got)) {
+                        if (!(this->storeLocal(got))) {
                             break;
                         }
                     }
@@ -499,12 +722,12 @@ namespace ch {
                     std::vector<std::thread> threads;
 
                     for (size_t i = 0; i < nWorker; ++i) {
-                        const ObjectInputStream<DataType> * stm = this->istreams[i++];
+                        ObjectInputStream<DataType> * stm = this->istreams[i];
 
-                        threads.emplace_back([this, &stm](){
-                            DataType * got = nullptr;
-                            while ((got = stm->recv())) {
-                                if (!this->_data.store(got)) {
+                        threads.emplace_back([this, stm](){
+                            DataType got;
+                            while (stm->recv(got)) {
+                                if (!this->storeLocal(got)) {
                                     break;
                                 }
                             }
@@ -638,26 +861,31 @@ namespace ch {
                                 FD_CLR(sockfd, &fdset_o);
                                 threadPool.addTask([this, sockfd, &endedReceive, &fdToIndex, &fdset_o](){
 #endif
-                                    const ObjectInputStream<DataType> * stm = this->istreams[fdToIndex[sockfd]];
-                                    DataType * got = nullptr;
+                                    ObjectInputStream<DataType> * stm = this->istreams[fdToIndex[sockfd]];
+                                    DataType got;
+                                    bool alive = true;
+
+                                    // Consume the whole block, socket may not be readable
+                                    // while records of the block remain
+                                    do {
+                                        if (!stm->recv(got) || !this->storeLocal(got)) {
+                                            alive = false;
+                                        }
+                                    } while (alive && stm->hasBuffered());
 
-                                    if ((got = stm->recv())) {
-                                        if (!this->_data.store(got)) {
-                                            ++endedReceive;
-                                        } else {
+                                    if (alive) {
 #if defined (__CH_KQUEUE__)
-                                            struct kevent event;
-                                            EV_SET(&event, sockfd, EVFILT_READ, EV_ENABLE, 0, 0, nullptr);
-                                            Kevent(kq, &event, 1, nullptr, 0, nullptr);
+                                        struct kevent event;
+                                        EV_SET(&event, sockfd, EVFILT_READ, EV_ENABLE, 0, 0, nullptr);
+                                        Kevent(kq, &event, 1, nullptr, 0, nullptr);
 #elif defined (__CH_EPOLL__)
-                                            struct epoll_event event;
-                                            event.events = EPOLLIN;
-                                            event.data.fd = sockfd;
-                                            epoll_ctl(ep, EPOLL_CTL_ADD, sockfd, &event);
+                                        struct epoll_event event;
+                                        event.events = EPOLLIN;
+                                        event.data.fd = sockfd;
+                                        epoll_ctl(ep, EPOLL_CTL_ADD, sockfd, &event);
 #else
-                                            FD_SET(sockfd, fdset_o);
+                                        FD_SET(sockfd, fdset_o);
 #endif
-                                        }
                                     } else {
                                         ++endedReceive;
                                     }
@@ -681,31 +909,41 @@ namespace ch {
     // Send stop signal to other machines, cause receive thread on other machines
     // to terminate and close connection
     // called when we don't need these connections anymore
+    // false if data sent may not be received
     template <typename DataType>
-    void StreamManager<DataType>::finalizeSend(void) {
+    bool StreamManager<DataType>::finalizeSend(void) {
+
+        bool ret = true;
 
         for (ObjectOutputStream<DataType> * stm: ostreams) {
             if (stm != nullptr) {
-                stm->close();
+                ret = stm->close() && ret;
                 delete stm;
             }
         }
 
         ostreams.clear();
 
+        return ret;
+
     }
 
     // Send stop signal to other machines, cause receive thread on other machines to terminate
     // called when we need to temporarily stop receiving (e.g. switch from map to reduce)
+    // false if data sent may not be received
     template <typename DataType>
-    void StreamManager<DataType>::stopSend(void) {
+    bool StreamManager<DataType>::stopSend(void) {
+
+        bool ret = true;
 
         for (ObjectOutputStream<DataType> * stm: ostreams) {
             if (stm != nullptr) {
-                stm->stop();
+                ret = stm->stop() && ret;
             }
         }
 
+        return ret;
+
     }
 
     // Cause the current thread to block until all receive thread end and clear resource
@@ -726,55 +964,216 @@ namespace ch {
     template <typename DataType>
     bool StreamManager<DataType>::push(DataType & v) {
 
-        size_t id = _partitioner->getPartition(v.hashCode(), clusterSize);
+        if (_sampleSize > 0) {
+            sample(v);
+        }
+
+        size_t id;
+
+        if (_hotKeys != nullptr && _hotKeys->contains(v)) {
+            if (_divert != nullptr) {
+                return _divert->push(v);
+            }
+
+            id = (_saltCursor++) % clusterSize;
+
+            if (_metrics != nullptr) {
+                ++(_metrics->skew.saltedRecords);
+            }
+        } else if (_localOutput) {
+            return storeLocal(v);
+        } else if (_rangePartitioner != nullptr) {
+            id = _rangePartitioner->getPartition(v);
+        } else {
+            id = _partitioner->getPartition(v.hashCode(), clusterSize);
+        }
 
         if (id == selfId) {
-            return _data.store(v);
+            return storeLocal(v);
         } else {
             return ostreams[id]->send(v);
         }
 
     }
 
+    // Get the data manager of a bucket
+    template <typename DataType>
+    inline DataManager<DataType> & StreamManager<DataType>::getBucket(size_t i) {
+
+        return (i == 0) ? _data : *(_buckets[i - 1]);
+
+    }
+
+    // Get the bucket of a record on this machine
+    // hash codes of records here may share low bits (the machine was chosen by them), so buckets
+    // are chosen by a remix of the hash code
+    template <typename DataType>
+    inline size_t StreamManager<DataType>::getBucketIndex(DataType & v) {
+
+        if (_nBuckets == 1) {
+            return 0;
+        }
+
+        return static_cast<unsigned int>(murmur2(v.hashCode())) % _nBuckets;
+
+    }
+
+    // Store data in its bucket on this machine
+    template <typename DataType>
+    bool StreamManager<DataType>::storeLocal(DataType & v) {
+
+        return getBucket(getBucketIndex(v)).store(v);
+
+    }
+
+
+    // Push data to all machines (including this one)
+    template <typename DataType>
+    bool StreamManager<DataType>::pushAll(DataType & v) {
+
+        for (size_t id = 0; id < clusterSize; ++id) {
+            if (id == selfId) {
+                if (!storeLocal(v)) {
+                    return false;
+                }
+            } else if (!ostreams[id]->send(v)) {
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+    // Add a pushed record to the reservoir sample
+    template <typename DataType>
+    void StreamManager<DataType>::sample(const DataType & v) {
+
+        std::lock_guard<std::mutex> holder{_sampleLock};
+
+        ++_sampled;
+
+        if (_samples.size() < _sampleSize) {
+            _samples.push_back(v);
+        } else {
+            size_t i = _random() % _sampled;
+
+            if (i < _sampleSize) {
+                _samples[i] = v;
+            }
+        }
+
+    }
+
     // Get sorted stream from data manager
     template <typename DataType>
     SortedStream<DataType> * StreamManager<DataType>::getSortedStream () {
 
+        if (_nBuckets > 1) {
+            E("(StreamManager) Data are in more than one bucket, get sorted streams instead.");
+            return nullptr;
+        }
+
         return _data.getSortedStream();
 
     }
 
-    // Pour data to text file with temporary files in data manager
+    // Get sorted streams of all buckets (empty buckets are skipped)
     template <typename DataType>
-    bool StreamManager<DataType>::pourToTextFile (const char * path) {
-        std::ofstream os(path);
+    void StreamManager<DataType>::getSortedStreams (
+        std::vector<std::unique_ptr<SortedStream<DataType> > > & sorteds) {
 
-        if (os) {
-            UnsortedStream<DataType> * unsorted = _data.getUnsortedStream();
+        sorteds.clear();
 
-            if (unsorted) {
-                std::unique_ptr<UnsortedStream<DataType> > _unsorted{unsorted};
+        for (size_t i = 0; i < _nBuckets; ++i) {
+            SortedStream<DataType> * sorted = getBucket(i).getSortedStream();
 
-                DataType temp;
-                while (unsorted->get(temp)) {
-                    os << temp.toString() << std::endl;
+            if (sorted != nullptr) {
+                sorteds.emplace_back(sorted);
+            }
+        }
 
-                    if (!os) {
-                        E("(StreamManager) Fail to write to text file.");
-                        I("Check if there is no space.");
-                        os.close();
-                        return false;
-                    }
+    }
+
+    // Get unsorted stream from data manager
+    template <typename DataType>
+    UnsortedStream<DataType> * StreamManager<DataType>::getUnsortedStream () {
+
+        return _data.getUnsortedStream();
+
+    }
+
+    // Pour data to text file with temporary files in data manager, a line per record in style
+    template <typename DataType>
+    bool StreamManager<DataType>::pourToTextFile (const char * path, size_t * records,
+                                                  uint32_t style) {
+
+        TextWriter<DataType> os{style};
+
+        if (!os.open(path)) {
+            return false;
+        }
+
+        UnsortedStream<DataType> * unsorted = _data.getUnsortedStream();
+
+        if (unsorted) {
+            std::unique_ptr<UnsortedStream<DataType> > _unsorted{unsorted};
+
+            DataType temp;
+            while (unsorted->get(temp)) {
+                if (!os.write(temp)) {
+                    return false;
                 }
             }
-            os.close();
-            return true;
-        } else {
-            E("(StreamManager) Fail to open file to write.");
-            I("Check if there is no space.");
+        }
+
+        if (!os.close()) {
             return false;
         }
 
+        if (records) {
+            *records = os.lines();
+        }
+
+        return true;
+
+    }
+
+    // Pour data to record file (blocks of serialized records in codec) with temporary
+    // files in data manager
+    template <typename DataType>
+    bool StreamManager<DataType>::pourToRecordFile (const char * path, size_t * records,
+                                                    uint32_t codec) {
+
+        RecordFileWriter<DataType> os{codec};
+
+        if (!os.open(path)) {
+            return false;
+        }
+
+        UnsortedStream<DataType> * unsorted = _data.getUnsortedStream();
+
+        if (unsorted) {
+            std::unique_ptr<UnsortedStream<DataType> > _unsorted{unsorted};
+
+            DataType temp;
+            while (unsorted->get(temp)) {
+                if (!os.write(temp)) {
+                    return false;
+                }
+            }
+        }
+
+        if (!os.close()) {
+            return false;
+        }
+
+        if (records) {
+            *records = os.records();
+        }
+
+        return true;
+
     }
 
     // Set presort of data manager
@@ -783,6 +1182,42 @@ namespace ch {
 
         _data.setPresort(presort);
 
+        for (std::unique_ptr<DataManager<DataType> > & bucket: _buckets) {
+            bucket->setPresort(presort);
+        }
+
+        if (!presort) {
+            _nBuckets = 1;
+        }
+
+    }
+
+    // Spread sorted data over k buckets on this machine
+    template <typename DataType>
+    void StreamManager<DataType>::setBuckets(size_t k) {
+
+        if (k == 0) {
+            k = 1;
+        }
+
+        while (_buckets.size() + 1 < k) {
+            _buckets.emplace_back(new DataManager<DataType>{_dir, _options, _metrics});
+        }
+
+        _nBuckets = k;
+
+    }
+
+    // Combine records by key as they are stored instead of sorting them
+    template <typename DataType>
+    void StreamManager<DataType>::setAggregate(bool aggregate) {
+
+        _data.setAggregate(aggregate);
+
+        for (std::unique_ptr<DataManager<DataType> > & bucket: _buckets) {
+            bucket->setAggregate(aggregate);
+        }
+
     }
 
     // Set partitioner
@@ -790,6 +1225,83 @@ namespace ch {
     void StreamManager<DataType>::setPartitioner(const Partitioner & partitioner) {
 
         _partitioner = std::addressof(partitioner);
+        _rangePartitioner = nullptr;
+
+    }
+
+    // Set partitioner by key range
+    template <typename DataType>
+    void StreamManager<DataType>::setPartitioner(const RangePartitioner<DataType> & partitioner) {
+
+        _rangePartitioner = std::addressof(partitioner);
+
+    }
+
+    // Keep a reservoir sample of size records pushed from now on
+    template <typename DataType>
+    void StreamManager<DataType>::setSampling(size_t size) {
+
+        std::lock_guard<std::mutex> holder{_sampleLock};
+
+        _sampleSize = size;
+        _sampled = 0;
+        _samples.clear();
+        _samples.reserve(size);
+        _random.seed(selfId + 1);
+
+    }
+
+    // Move the sample out
+    template <typename DataType>
+    void StreamManager<DataType>::getSamples(std::vector<DataType> & samples) {
+
+        std::lock_guard<std::mutex> holder{_sampleLock};
+
+        samples = std::move(_samples);
+        _samples.clear();
+        _sampleSize = 0;
+
+    }
+
+    // Number of records seen by sampling
+    template <typename DataType>
+    size_t StreamManager<DataType>::sampledRecords() {
+
+        std::lock_guard<std::mutex> holder{_sampleLock};
+
+        return _sampled;
+
+    }
+
+    // Salt records of hot keys, or push them to divert
+    template <typename DataType>
+    void StreamManager<DataType>::setHotKeys(const HotKeys<DataType> * hotKeys,
+                                             StreamManager<DataType> * divert) {
+
+        _hotKeys = hotKeys;
+        _divert = divert;
+
+    }
+
+    // Number of records stored on this machine since data were last got as a stream
+    template <typename DataType>
+    size_t StreamManager<DataType>::storedRecords() {
+
+        size_t stored = 0;
+
+        for (size_t i = 0; i < _nBuckets; ++i) {
+            stored += getBucket(i).stored();
+        }
+
+        return stored;
+
+    }
+
+    // Keep pushed data on this machine
+    template <typename DataType>
+    void StreamManager<DataType>::setLocalOutput(bool localOutput) {
+
+        _localOutput = localOutput;
 
     }
 }
@@ -0,0 +1,181 @@
+/*
+ * Text output of records, formatted into one buffer and written in large chunks
+ */
+
+#ifndef TEXTWRITER_H
+#define TEXTWRITER_H
+
+#include <unistd.h>   // write, close
+#include <fcntl.h>    // open, O_xxx
+#include <errno.h>    // errno, EINTR
+#include <stdint.h>   // uint32_t
+
+#include <string>     // string
+
+#include "def.hpp"    // TEXT_xxx, TEXT_WRITE_BUFFER_SIZE, BUFFER_SIZE, E, I
+
+namespace ch {
+
+    /********************************************
+     ************** Declaration *****************
+    ********************************************/
+
+    /*
+     * TextWriter: a line per record in a style (TEXT_xxx), records format themselves into the
+     * buffer, which is written once it holds TEXT_WRITE_BUFFER_SIZE bytes
+     */
+    template <typename DataType>
+    class TextWriter {
+
+        protected:
+
+            // Descriptor of the file, -1 if not opened
+            int _fd;
+
+            // Style of lines
+            const uint32_t _style;
+
+            // Lines not written yet, its capacity is kept
+            std::string _buffer;
+
+            // Number of lines written
+            size_t _lines;
+
+            // Write the buffer to file
+            bool flush();
+
+        public:
+
+            // Constructor
+            explicit TextWriter(uint32_t style = TEXT_REPR);
+
+            // Copy constructor (deleted)
+            TextWriter(const TextWriter<DataType> &) = delete;
+
+            // Copy assignment (deleted)
+            TextWriter<DataType> & operator = (const TextWriter<DataType> &) = delete;
+
+            // Destructor
+            ~TextWriter();
+
+            // Create (or truncate) file at path
+            bool open(const char * path);
+
+            // Write a record as a line
+            bool write(const DataType & v);
+
+            // Flush and close the file
+            bool close();
+
+            // Number of lines written
+            size_t lines() const;
+    };
+
+    /********************************************
+     ************ Implementation ****************
+    ********************************************/
+
+    // Write the buffer to file
+    template <typename DataType>
+    bool TextWriter<DataType>::flush() {
+
+        const char * data = _buffer.data();
+        size_t length = _buffer.size();
+
+        while (length != 0) {
+            ssize_t written = ::write(_fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                E("(TextWriter) Fail to write to text file.");
+                I("Check if there is no space.");
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+
+        _buffer.clear();
+
+        return true;
+
+    }
+
+    // Constructor
+    template <typename DataType>
+    TextWriter<DataType>::TextWriter(uint32_t style): _fd{-1}, _style{style}, _lines{0} {}
+
+    // Destructor
+    template <typename DataType>
+    TextWriter<DataType>::~TextWriter() {
+
+        close();
+
+    }
+
+    // Create (or truncate) file at path
+    template <typename DataType>
+    bool TextWriter<DataType>::open(const char * path) {
+
+        close();
+
+        _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (_fd == -1) {
+            E("(TextWriter) Fail to open file to write.");
+            I("Check if there is no space.");
+            return false;
+        }
+
+        _buffer.reserve(TEXT_WRITE_BUFFER_SIZE + BUFFER_SIZE);
+        _lines = 0;
+
+        return true;
+
+    }
+
+    // Write a record as a line
+    template <typename DataType>
+    inline bool TextWriter<DataType>::write(const DataType & v) {
+
+        v.format(_buffer, _style);
+        _buffer += '\n';
+        ++_lines;
+
+        if (_buffer.size() >= TEXT_WRITE_BUFFER_SIZE) {
+            return flush();
+        }
+
+        return true;
+
+    }
+
+    // Flush and close the file
+    template <typename DataType>
+    bool TextWriter<DataType>::close() {
+
+        if (_fd == -1) {
+            return true;
+        }
+
+        bool ret = flush();
+
+        ret = (::close(_fd) == 0) && ret;
+        _fd = -1;
+        _buffer.clear();
+
+        return ret;
+
+    }
+
+    // Number of lines written
+    template <typename DataType>
+    inline size_t TextWriter<DataType>::lines() const {
+
+        return _lines;
+
+    }
+}
+
+#endif
@@ -5,12 +5,16 @@
 #ifndef TYPE_HPP
 #define TYPE_HPP
 
+#include <string.h>   // memcpy
+#include <stddef.h>   // ptrdiff_t
+#include <stdint.h>   // uint64_t, uint32_t
+
 #include <string>     // string, to_string
 #include <iostream>   // ostream
 #include <fstream>    // ifstream, ofstream
 
-#include "def.hpp"    // ID_xxx
-#include "utils.hpp"  // precv, psend, sendString, receiveString
+#include "def.hpp"    // ID_xxx, TEXT_xxx
+#include "utils.hpp"  // precv, psend, sendString, receiveString, appendDecimal
 #include "murmur.hpp" // murmur2
 
 namespace ch {
@@ -38,6 +42,11 @@ namespace ch {
             // Get string representation of the object
             virtual std::string toString() const = 0;
 
+            // Append text of the object in style (TEXT_xxx) to buffer, toString unless overridden
+            virtual void format(std::string & buf, uint32_t style) const {
+                buf += toString();
+            }
+
             // Send the object through a socket
             virtual bool send(int fd) const = 0;
 
@@ -50,6 +59,18 @@ namespace ch {
             // write to file stream
             virtual std::ofstream & write(std::ofstream & os) const = 0;
 
+            // Append the serialized object to buffer
+            virtual void pack(std::string & buf) const = 0;
+
+            // Deserialize the object from buffer and advance the cursor
+            virtual bool unpack(const char * & cur, const char * end) = 0;
+
+            // Order preserving 64-bit prefix, true if equal prefixes mean equal values
+            virtual bool sortPrefix(uint64_t & prefix) const = 0;
+
+            // Bytes the object takes in memory (including heap)
+            virtual size_t footprint() const = 0;
+
             // Output to file
             friend std::ofstream & operator << (std::ofstream & os, const TypeBase & v);
 
@@ -95,6 +116,9 @@ namespace ch {
             std::string toString(void) const {
                 return std::to_string(value);
             }
+            void format(std::string & buf, uint32_t style) const {
+                appendDecimal(buf, value);
+            }
             inline static id_t getId(void) {
                 return ID_INTEGER;
             }
@@ -112,6 +136,26 @@ namespace ch {
                 os.write(reinterpret_cast<const char *>(&value), sizeof(int));
                 return os;
             }
+            void pack(std::string & buf) const {
+                buf.append(reinterpret_cast<const char *>(&value), sizeof(int));
+            }
+            bool unpack(const char * & cur, const char * end) {
+                if (end - cur < static_cast<ptrdiff_t>(sizeof(int))) {
+                    return false;
+                }
+                memcpy(&value, cur, sizeof(int));
+                cur += sizeof(int);
+                return true;
+            }
+            // Order preserving prefix, true if equal prefixes mean equal values
+            bool sortPrefix(uint64_t & prefix) const {
+                prefix = static_cast<uint32_t>(value) ^ 0x80000000u;
+                return true;
+            }
+            // Bytes the object takes in memory (including heap)
+            size_t footprint() const {
+                return sizeof(Integer);
+            }
 
             // Operator overriding
             bool operator == (const Integer & b) const {
@@ -189,6 +233,37 @@ namespace ch {
             std::string toString(void) const {
                 return "\"" + value + "\"";
             }
+            void format(std::string & buf, uint32_t style) const {
+                if (style == TEXT_CSV) {
+                    if (value.find_first_of(",\"\r\n") == std::string::npos) {
+                        buf += value;
+                        return;
+                    }
+                    // Quoted, with quotes doubled
+                    buf += '"';
+                    for (char c: value) {
+                        if (c == '"') {
+                            buf += '"';
+                        }
+                        buf += c;
+                    }
+                    buf += '"';
+                } else if (style == TEXT_TSV) {
+                    for (char c: value) {
+                        switch (c) {
+                            case '\t': buf.append("\\t", 2); break;
+                            case '\n': buf.append("\\n", 2); break;
+                            case '\r': buf.append("\\r", 2); break;
+                            case '\\': buf.append("\\\\", 2); break;
+                            default: buf += c;
+                        }
+                    }
+                } else {
+                    buf += '"';
+                    buf += value;
+                    buf += '"';
+                }
+            }
             inline static id_t getId(void) {
                 return ID_STRING;
             }
@@ -215,6 +290,41 @@ namespace ch {
                 }
                 return os;
             }
+            void pack(std::string & buf) const {
+                size_t l = value.size();
+                buf.append(reinterpret_cast<const char *>(&l), sizeof(size_t));
+                buf.append(value);
+            }
+            bool unpack(const char * & cur, const char * end) {
+                size_t l;
+                hashGot = false;
+                if (end - cur < static_cast<ptrdiff_t>(sizeof(size_t))) {
+                    return false;
+                }
+                memcpy(&l, cur, sizeof(size_t));
+                cur += sizeof(size_t);
+                if (static_cast<size_t>(end - cur) < l) {
+                    return false;
+                }
+                value.assign(cur, l);
+                cur += l;
+                return true;
+            }
+            // Order preserving prefix, true if equal prefixes mean equal values
+            // (first 7 bytes, then length if it is less than 8)
+            bool sortPrefix(uint64_t & prefix) const {
+                const size_t l = value.size();
+                prefix = 0;
+                for (size_t i = 0; i < 7; ++i) {
+                    prefix = (prefix << 8) | ((i < l) ? static_cast<unsigned char>(value[i]) : 0);
+                }
+                prefix = (prefix << 8) | ((l < 8) ? l : 0xFF);
+                return (l < 8);
+            }
+            // Bytes the object takes in memory (including heap)
+            size_t footprint() const {
+                return sizeof(String) + value.capacity();
+            }
 
             // Operator overriding
             bool operator == (const String & b) const {
@@ -295,6 +405,19 @@ namespace ch {
             std::string toString() const {
                 return "(" + first.toString() + ", " + second.toString() + ")";
             }
+            void format(std::string & buf, uint32_t style) const {
+                if (style == TEXT_CSV || style == TEXT_TSV) {
+                    first.format(buf, style);
+                    buf += (style == TEXT_CSV) ? ',' : '\t';
+                    second.format(buf, style);
+                } else {
+                    buf += '(';
+                    first.format(buf, style);
+                    buf.append(", ", 2);
+                    second.format(buf, style);
+                    buf += ')';
+                }
+            }
             inline static id_t getId(void) {
                 return (DataType_1::getId() << 3) ^ DataType_2::getId();
             }
@@ -310,6 +433,22 @@ namespace ch {
             std::ofstream & write(std::ofstream & os) const {
                 return os << first << second;
             }
+            void pack(std::string & buf) const {
+                first.pack(buf);
+                second.pack(buf);
+            }
+            bool unpack(const char * & cur, const char * end) {
+                return first.unpack(cur, end) && second.unpack(cur, end);
+            }
+            // Order preserving prefix (of key), true if equal prefixes mean equal keys
+            bool sortPrefix(uint64_t & prefix) const {
+                return first.sortPrefix(prefix);
+            }
+            // Bytes the object takes in memory (including heap)
+            size_t footprint() const {
+                return sizeof(Tuple<DataType_1, DataType_2>) - sizeof(DataType_1) - sizeof(DataType_2) +
+                       first.footprint() + second.footprint();
+            }
 
             // Operator overriding
             bool operator == (const Tuple<DataType_1, DataType_2> & b) const {
@@ -1,15 +1,14 @@
 /*
- * Unsorted stream over bunch of files, read files one by one
+ * Unsorted stream over bunch of runs, read runs one by one
  */
 
 #ifndef UNSORTEDSTREAM_H
 #define UNSORTEDSTREAM_H
 
-#include <unistd.h> // unlink
+#include <vector>          // vector
+#include <memory>          // unique_ptr
 
-#include <vector>   // vector
-#include <string>   // string
-#include <fstream>  // ifstream
+#include "runReader.hpp"   // RunReader
 
 namespace ch {
 
@@ -22,19 +21,16 @@ namespace ch {
 
         protected:
 
-            // Files it manages
-            const std::vector<std::string> _files;
+            // Runs it reads
+            std::vector<std::unique_ptr<RunReader<DataType> > > _runs;
 
-            // Index of next file
-            size_t i;
-
-            // Input stream of current file
-            std::ifstream is;
+            // Index of current run
+            size_t _run;
 
         public:
 
             // Constructor
-            UnsortedStream(std::vector<std::string> && files);
+            UnsortedStream();
 
             // Copy constructor (deleted)
             UnsortedStream(const UnsortedStream<DataType> &) = delete;
@@ -48,8 +44,8 @@ namespace ch {
             // Move assignment
             UnsortedStream<DataType> & operator = (UnsortedStream<DataType> && o);
 
-            // Destructor
-            ~UnsortedStream();
+            // Read a run after the others, the stream owns it
+            void addRun(RunReader<DataType> * run);
 
             // True if stream is good
             bool isValid();
@@ -64,44 +60,29 @@ namespace ch {
 
     // Constructor
     template <typename DataType>
-    UnsortedStream<DataType>::UnsortedStream(std::vector<std::string> && files)
-    : _files(std::move(files)) {
-
-        i = 0;
-
-        while (!isValid() && i < _files.size()) {
-            is.close();
-            is.open(_files[i++]);
-        }
-
-        files.clear();
-
-    }
+    UnsortedStream<DataType>::UnsortedStream(): _run{0} {}
 
     // Move constructor
     template <typename DataType>
     UnsortedStream<DataType>::UnsortedStream(UnsortedStream<DataType> && o)
-    : _files{std::move(o._files)}, i{o.i}, is{std::move(o.is)} {}
+    : _runs{std::move(o._runs)}, _run{o._run} {}
 
     // Move assignment
     template <typename DataType>
     UnsortedStream<DataType> &
         UnsortedStream<DataType>::operator = (UnsortedStream<DataType> && o) {
 
-        _files = std::move(o._files);
-        i = o.i;
-        is = std::move(o.is);
+        _runs = std::move(o._runs);
+        _run = o._run;
         return *this;
 
     }
 
-    // Destructor
+    // Read a run after the others, the stream owns it
     template <typename DataType>
-    UnsortedStream<DataType>::~UnsortedStream() {
+    void UnsortedStream<DataType>::addRun(RunReader<DataType> * run) {
 
-        for (const std::string & file: _files) {
-            unlink(file.c_str());
-        }
+        _runs.emplace_back(run);
 
     }
 
@@ -109,7 +90,7 @@ namespace ch {
     template <typename DataType>
     inline bool UnsortedStream<DataType>::isValid() {
 
-        return bool(is);
+        return _run < _runs.size();
 
     }
 
@@ -117,16 +98,14 @@ namespace ch {
     template <typename DataType>
     bool UnsortedStream<DataType>::get(DataType & ret) {
 
-        while (!(isValid() && (is >> ret))) {
-            is.close();
-            if (i < _files.size()) {
-                is.open(_files[i++]);
-            } else {
-                return false;
+        for (; _run < _runs.size(); ++_run) {
+            if (_runs[_run]->read(ret)) {
+                return true;
             }
+            _runs[_run].reset();
         }
 
-        return true;
+        return false;
 
     }
 
@@ -17,6 +17,7 @@
 #include <string>       // string
 #include <random>       // random_device, default_random_engine, uniform_int_distribution
 #include <functional>   // bind
+#include <atomic>       // atomic
 
 #include "def.hpp"      // select/kqueue/epoll header
 
@@ -60,7 +61,8 @@ namespace ch {
     bool sconnect(int & sockfd, const char * ip, const unsigned short port);
 
     // Prepare to accept connection
-    bool prepareServer(int & serverfd, const unsigned short port);
+    // reuseAddress allows binding a port with connections in TIME_WAIT
+    bool prepareServer(int & serverfd, const unsigned short port, bool reuseAddress = false);
 
     // Get integer and forward iterator
     // helper function for isValidIP_v4
@@ -135,6 +137,12 @@ namespace ch {
 
     // Generate random string of length l
     std::string randomString(size_t l);
+
+    // Index of the calling thread, threads are numbered in order of first call
+    size_t threadIndex();
+
+    // Append decimal digits of v to buf, nothing is allocated if buf has room
+    void appendDecimal(std::string & buf, long long v);
 }
 
 #endif
@@ -1,13 +1,14 @@
-#include <unistd.h>  // getopt, getcwd, close
-#include <time.h>    // time
+#include <unistd.h>   // getopt, getcwd, close
+#include <time.h>     // time
+#include <sys/stat.h> // stat, S_ISDIR
 
-#include <string>    // string, getline
-#include <iostream>  // cout
-#include <fstream>   // ifstream, ofstream
-#include <chrono>    // system_clock, duration_cast, milliseconds
+#include <string>     // string, getline
+#include <iostream>   // cout
+#include <fstream>    // ifstream, ofstream
+#include <chrono>     // system_clock, duration_cast, milliseconds
 
-#include "utils.hpp" // isValidIP_v4, precv, fileExist, getWorkingDirectory,
-                     // randomString,sconnect, invokeMaster, sendString
+#include "utils.hpp"  // isValidIP_v4, precv, fileExist, getWorkingDirectory,
+                      // randomString,sconnect, invokeMaster, sendString, receiveString
 
 // Index IPs in configuration file
 bool createTargetConfigurationFile (const std::string & confFilePath,
@@ -87,8 +88,9 @@ bool parseArgs(const int argc, char * const* argv, std::string & confFilePath, s
 
 }
 
-// Get result from master
-void getResult(const int sockfd) {
+// Get result and output manifest from master
+// the manifest is saved in the output directory if the output is written as part files
+void getResult(const int sockfd, const std::string & outputFilePath) {
 
     char c;
 
@@ -96,6 +98,27 @@ void getResult(const int sockfd) {
         P("No response from the server.");
     } else if (c == RES_SUCCESS) {
         P("Job Succeed.");
+
+        std::string manifest;
+
+        if (!ch::receiveString(sockfd, manifest)) {
+            E("Cannot receive output manifest.");
+            return;
+        }
+
+        std::cout << "Output (id ip path records bytes):\n" << manifest;
+
+        struct stat st;
+
+        if (stat(outputFilePath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            std::ofstream mos{outputFilePath + MANIFEST_FILE};
+
+            mos << manifest;
+
+            if (!mos) {
+                E("Cannot write output manifest.");
+            }
+        }
     } else {
         P("Job Fail.");
     }
@@ -114,7 +137,7 @@ int main(int argc, char ** argv) {
     std::string targetConfFilePath;
 
     if (!parseArgs(argc, argv, confFilePath, dataFilePath, outputFilePath, jobFilePath)) {
-        P("Usage: chrun\n -c [configuration file]\n -i [input data]\n -o [output file]\n -j [job file]");
+        P("Usage: chrun\n -c [configuration file]\n -i [input data]\n -o [output file/directory]\n -j [job file]");
         return 0;
     }
 
@@ -207,7 +230,7 @@ int main(int argc, char ** argv) {
 
     std::cout << "Job " << jobName << " started.\n";
 
-    getResult(sockfd);
+    getResult(sockfd, outputFilePath);
 
     std::cout << "In " << duration_cast<milliseconds>(system_clock::now() - start).count() << " ms.\n";
 
@@ -11,11 +11,16 @@
 #include "def.hpp"           // SERVER_PORT, CALL_xxx
 #include "sourceManager.hpp" // SourceManagerWorker, SourceManagerMaster
 #include "job.hpp"           // job_f, context_t
+#include "shuffleMesh.hpp"   // ShuffleMesh
 #include "utils.hpp"         // readIPs, receiveString, getWorkingDirectory,
-                             // sendFail, sendSuccess, prepareServer
+                             // sendFail, sendSuccess, sendString, prepareServer
 
 int serverfd = INVALID_SOCKET;
 
+// Connections to other servers shared by jobs, nullptr if the mesh failed to start
+// (lives till the process exits)
+ch::ShuffleMesh * mesh = nullptr;
+
 // Function call on SIGINT
 // Close on Ctrl + C
 void sigintHandler(int signo) {
@@ -74,7 +79,8 @@ bool runJob(const std::string & jobFilePath, ch::context_t & context) {
 }
 
 // Run as worker
-bool asWorker(const int sockfd) {
+// manifest is set to the output files written on this machine
+bool asWorker(const int sockfd, std::string & manifest) {
 
     P("Running as worker.");
 
@@ -85,19 +91,26 @@ bool asWorker(const int sockfd) {
         std::string jobName;
         std::string confFilePath;
         std::string workingDir;
+        std::string outputFilePath;
 
-        if (source.receiveFiles(confFilePath, jobFilePath, jobName, workingDir)) {
+        if (source.receiveFiles(confFilePath, jobFilePath, jobName, workingDir, outputFilePath)) {
             ipconfig_t ips;
 
             if (ch::readIPs(confFilePath, ips)) {
                 // do job
-                const std::string outputFilePath;
 #ifdef MULTIPLE_MAPPER
-                ch::context_t context(ips, source, outputFilePath, workingDir, jobName, false, true);
+                ch::context_t context(ips, source, outputFilePath, workingDir, jobName, false, true,
+                                      mesh);
 #else
-                ch::context_t context(ips, source, outputFilePath, workingDir, jobName, false, false);
+                ch::context_t context(ips, source, outputFilePath, workingDir, jobName, false, false,
+                                      mesh);
 #endif
-                return runJob(jobFilePath, context);
+                bool ret = runJob(jobFilePath, context);
+                if (mesh != nullptr) {
+                    mesh->endJob(jobName);
+                }
+                manifest = context._manifest;
+                return ret;
             } else {
                 E("Cannot read configuration file.");
             }
@@ -111,7 +124,8 @@ bool asWorker(const int sockfd) {
 }
 
 // Run as master
-bool asMaster(int sockfd) {
+// manifest is set to the output files written on all machines
+bool asMaster(int sockfd, std::string & manifest) {
 
     std::string dataFilePath;
     std::string outputFilePath;
@@ -161,7 +175,7 @@ bool asMaster(int sockfd) {
 
     if (source.isValid()) {
 
-        if (!source.connectAndDeliver(ips, jobName)) {
+        if (!source.connectAndDeliver(ips, jobName, outputFilePath)) {
             E("Fail to connect to workers.");
             return false;
         }
@@ -170,11 +184,15 @@ bool asMaster(int sockfd) {
 
         // do job
 #ifdef MULTIPLE_MAPPER
-        ch::context_t context(ips, source, outputFilePath, workingDir, jobName, true, true);
+        ch::context_t context(ips, source, outputFilePath, workingDir, jobName, true, true, mesh);
 #else
-        ch::context_t context(ips, source, outputFilePath, workingDir, jobName, true, false);
+        ch::context_t context(ips, source, outputFilePath, workingDir, jobName, true, false, mesh);
 #endif
-        if (!runJob(jobFilePath, context)) {
+        bool ret = runJob(jobFilePath, context);
+        if (mesh != nullptr) {
+            mesh->endJob(jobName);
+        }
+        if (!ret) {
             ESS("Job " << jobName << " on master failed.");
             return false;
         }
@@ -188,6 +206,9 @@ bool asMaster(int sockfd) {
             return false;
         }
 
+        manifest = context._manifest;
+        source.appendWorkerManifests(manifest);
+
         return true;
     } else {
         E("Fail to open data/job file.");
@@ -205,18 +226,22 @@ void serve(const int sockfd) {
 
         if (ch::precv(sockfd, static_cast<void *>(&c), sizeof(char))) {
             P("Job accepted.");
+            std::string manifest;
+
             if (c == CALL_MASTER) {
-                if (!asMaster(sockfd)) {
+                if (!asMaster(sockfd, manifest)) {
                     ch::sendFail(sockfd);
                 } else {
                     ch::sendSuccess(sockfd);
+                    ch::sendString(sockfd, manifest);
                 }
             } else if (c == CALL_WORKER) {
                 // Result to be processed by sourceManager
-                if (!asWorker(sockfd)) {
+                if (!asWorker(sockfd, manifest)) {
                     ch::sendFail(sockfd);
                 } else {
                     ch::sendSuccess(sockfd);
+                    ch::sendString(sockfd, manifest);
                 }
             } else if (c == CALL_CANCEL) {
                 P("Job canceled by master.");
@@ -239,6 +264,14 @@ int main(int argc, char ** argv) {
     socklen_t s_size;
 
     if (ch::prepareServer(serverfd, SERVER_PORT)) {
+        mesh = new ch::ShuffleMesh{};
+        if (!mesh->start()) {
+            delete mesh;
+            mesh = nullptr;
+            E("Cannot start shuffle mesh.");
+            I("Jobs connect to each other on their own.");
+        }
+
         P("Accepting request.");
 
         while (1) {
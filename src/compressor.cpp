@@ -0,0 +1,285 @@
+#include <string.h> // memcpy
+
+#include "compressor.hpp"
+
+/*
+ * LZ codec: sequences of (token, literals, offset, match)
+ * token holds literal length (high 4 bits) and match length - LZ_MIN_MATCH (low 4 bits),
+ * 15 means the length continues in following bytes (each 255 means more)
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 13
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 5 // the last bytes are always literals
+#define LZ_MATCH_FIND_LIMIT 12 // no match starts within the last bytes
+
+namespace ch {
+
+    namespace {
+
+        inline uint32_t read32(const unsigned char * p) {
+
+            uint32_t v;
+            memcpy(&v, p, sizeof(uint32_t));
+            return v;
+
+        }
+
+        inline uint32_t hashSequence(uint32_t v) {
+
+            return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+
+        }
+
+        // Write the remaining of a length not fit in token
+        inline unsigned char * writeLength(unsigned char * op, size_t len) {
+
+            while (len >= 255) {
+                *op++ = 255;
+                len -= 255;
+            }
+            *op++ = static_cast<unsigned char>(len);
+            return op;
+
+        }
+
+        // Read the remaining of a length not fit in token
+        inline bool readLength(const unsigned char * & ip, const unsigned char * iend, size_t & len) {
+
+            unsigned char b;
+
+            do {
+                if (ip >= iend) {
+                    return false;
+                }
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+
+            return true;
+
+        }
+
+        // Write a sequence, match is ignored if matchLength is 0
+        inline unsigned char * writeSequence(unsigned char * op, const unsigned char * literals,
+                                             size_t literalLength, size_t offset, size_t matchLength) {
+
+            unsigned char * token = op++;
+            size_t m = (matchLength == 0) ? 0 : matchLength - LZ_MIN_MATCH;
+
+            *token = static_cast<unsigned char>((MIN_VAL(literalLength, 15) << 4) | MIN_VAL(m, 15));
+
+            if (literalLength >= 15) {
+                op = writeLength(op, literalLength - 15);
+            }
+            memcpy(op, literals, literalLength);
+            op += literalLength;
+
+            if (matchLength != 0) {
+                *op++ = static_cast<unsigned char>(offset & 0xff);
+                *op++ = static_cast<unsigned char>(offset >> 8);
+                if (m >= 15) {
+                    op = writeLength(op, m - 15);
+                }
+            }
+
+            return op;
+
+        }
+    }
+
+    // Upper bound of the compressed length of len bytes
+    size_t compressBound(size_t len) {
+
+        return len + len / 255 + 16;
+
+    }
+
+    // Compress len bytes from src to dst
+    // return compressed length, 0 if capacity is less than compressBound(len)
+    size_t lzCompress(const char * src, size_t len, char * dst, size_t capacity) {
+
+        if (capacity < compressBound(len)) {
+            return 0;
+        }
+
+        const unsigned char * const base = reinterpret_cast<const unsigned char *>(src);
+        const unsigned char * const iend = base + len;
+        const unsigned char * ip = base;
+        const unsigned char * anchor = base;
+        unsigned char * op = reinterpret_cast<unsigned char *>(dst);
+
+        if (len > LZ_MATCH_FIND_LIMIT) {
+            const unsigned char * const findLimit = iend - LZ_MATCH_FIND_LIMIT;
+            const unsigned char * const matchLimit = iend - LZ_LAST_LITERALS;
+            uint32_t table[1 << LZ_HASH_BITS];
+
+            memset(table, 0, sizeof(table));
+
+            while (ip <= findLimit) {
+                const uint32_t sequence = read32(ip);
+                uint32_t & slot = table[hashSequence(sequence)];
+                const unsigned char * ref = base + slot;
+
+                slot = static_cast<uint32_t>(ip - base);
+
+                if (ref < ip && ip - ref <= LZ_MAX_OFFSET && read32(ref) == sequence) {
+                    const unsigned char * mp = ip + LZ_MIN_MATCH;
+                    const unsigned char * rp = ref + LZ_MIN_MATCH;
+
+                    while (mp < matchLimit && *mp == *rp) {
+                        ++mp;
+                        ++rp;
+                    }
+
+                    op = writeSequence(op, anchor, ip - anchor, ip - ref, mp - ip);
+                    ip = mp;
+                    anchor = ip;
+                } else {
+                    ++ip;
+                }
+            }
+        }
+
+        op = writeSequence(op, anchor, iend - anchor, 0, 0);
+
+        return op - reinterpret_cast<unsigned char *>(dst);
+
+    }
+
+    // Decompress len bytes from src to exactly rawLength bytes in dst
+    bool lzDecompress(const char * src, size_t len, char * dst, size_t rawLength) {
+
+        const unsigned char * ip = reinterpret_cast<const unsigned char *>(src);
+        const unsigned char * const iend = ip + len;
+        unsigned char * const obase = reinterpret_cast<unsigned char *>(dst);
+        unsigned char * const oend = obase + rawLength;
+        unsigned char * op = obase;
+
+        while (ip < iend) {
+            const unsigned char token = *ip++;
+            size_t literalLength = token >> 4;
+
+            if (literalLength == 15 && !readLength(ip, iend, literalLength)) {
+                return false;
+            }
+            if (literalLength > static_cast<size_t>(iend - ip) ||
+                literalLength > static_cast<size_t>(oend - op)) {
+                return false;
+            }
+            memcpy(op, ip, literalLength);
+            op += literalLength;
+            ip += literalLength;
+
+            if (ip == iend) { // last sequence has no match
+                break;
+            }
+            if (iend - ip < 2) {
+                return false;
+            }
+
+            const size_t offset = ip[0] | (ip[1] << 8);
+            size_t matchLength = token & 15;
+            ip += 2;
+
+            if (matchLength == 15 && !readLength(ip, iend, matchLength)) {
+                return false;
+            }
+            matchLength += LZ_MIN_MATCH;
+
+            if (offset == 0 || offset > static_cast<size_t>(op - obase) ||
+                matchLength > static_cast<size_t>(oend - op)) {
+                return false;
+            }
+
+            const unsigned char * ref = op - offset;
+
+            if (offset >= matchLength) {
+                memcpy(op, ref, matchLength);
+                op += matchLength;
+            } else { // overlapped copy
+                while (matchLength--) {
+                    *op++ = *ref++;
+                }
+            }
+        }
+
+        return op == oend;
+
+    }
+
+    // Append block (header and payload) of count serialized records to out
+    // fall back to CODEC_NONE if the block is not compressible
+    void encodeBlock(const std::string & raw, uint32_t count, uint32_t codec,
+                     std::string & out, codecMetrics_t * metrics, uint64_t firstKey) {
+
+        blockHeader_t header;
+        header.rawLength = raw.size();
+        header.count = count;
+        header.firstKey = firstKey;
+
+        const size_t headerOffset = out.size();
+        out.append(reinterpret_cast<const char *>(&header), sizeof(blockHeader_t));
+
+        if (codec == CODEC_LZ) {
+            const uint64_t start = threadCPUTime();
+            const size_t bound = compressBound(raw.size());
+            const size_t payloadOffset = out.size();
+
+            out.resize(payloadOffset + bound);
+            size_t l = lzCompress(raw.data(), raw.size(), &out[payloadOffset], bound);
+
+            if (l > 0 && l < raw.size()) {
+                out.resize(payloadOffset + l);
+                header.codec = CODEC_LZ;
+                header.storedLength = l;
+            } else {
+                out.resize(payloadOffset);
+                out.append(raw);
+                header.codec = CODEC_NONE;
+                header.storedLength = raw.size();
+            }
+
+            if (metrics != nullptr) {
+                metrics->addCompression(raw.size(), header.storedLength, threadCPUTime() - start);
+            }
+        } else {
+            out.append(raw);
+            header.codec = CODEC_NONE;
+            header.storedLength = raw.size();
+        }
+
+        memcpy(&out[headerOffset], &header, sizeof(blockHeader_t));
+
+    }
+
+    // Decode payload of a block to serialized records
+    bool decodeBlock(const blockHeader_t & header, const char * payload,
+                     std::string & raw, codecMetrics_t * metrics) {
+
+        if (header.codec == CODEC_NONE) {
+            if (header.rawLength != header.storedLength) {
+                return false;
+            }
+            raw.assign(payload, header.storedLength);
+            return true;
+        } else if (header.codec == CODEC_LZ) {
+            const uint64_t start = threadCPUTime();
+
+            raw.resize(header.rawLength);
+            if (!lzDecompress(payload, header.storedLength, &raw[0], header.rawLength)) {
+                E("(Compressor) Corrupted block.");
+                return false;
+            }
+
+            if (metrics != nullptr) {
+                metrics->addDecompression(threadCPUTime() - start);
+            }
+            return true;
+        }
+
+        E("(Compressor) Unknown codec.");
+        return false;
+
+    }
+}
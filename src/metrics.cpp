@@ -0,0 +1,182 @@
+#include <time.h>   // clock_gettime
+
+#include <sstream>  // ostringstream
+#include <iomanip>  // setprecision
+
+#include "metrics.hpp"
+
+namespace ch {
+
+    // Record an encoded block
+    void codecMetrics_t::addCompression(uint64_t raw, uint64_t stored, uint64_t time) {
+
+        ++blocks;
+        rawBytes += raw;
+        storedBytes += stored;
+        compressTime += time;
+
+    }
+
+    // Record a decoded block
+    void codecMetrics_t::addDecompression(uint64_t time) {
+
+        decompressTime += time;
+
+    }
+
+    // Compression ratio (raw / stored), 1 if nothing compressed
+    double codecMetrics_t::ratio() const {
+
+        uint64_t stored = storedBytes;
+
+        if (stored == 0) {
+            return 1;
+        }
+
+        return static_cast<double>(rawBytes) / stored;
+
+    }
+
+    // Get string representation of the counters
+    std::string codecMetrics_t::toString() const {
+
+        std::ostringstream ss;
+
+        ss << blocks << " blocks, " << rawBytes << " -> " << storedBytes << " bytes (ratio "
+           << std::fixed << std::setprecision(2) << ratio() << "), compress "
+           << compressTime / 1000000 << " ms, decompress " << decompressTime / 1000000 << " ms";
+
+        return ss.str();
+
+    }
+
+    // Get string representation of the counters
+    std::string flowMetrics_t::toString() const {
+
+        std::ostringstream ss;
+
+        ss << deferredBlocks << " blocks deferred, " << overflowBytes << " bytes overflowed to disk, "
+           << waitTime / 1000000 << " ms waiting for credits";
+
+        return ss.str();
+
+    }
+
+    // Get string representation of the counters
+    std::string skewMetrics_t::toString() const {
+
+        std::ostringstream ss;
+
+        ss << reduceRecords << " records to reduce, " << hotKeys << " hot keys, "
+           << saltedRecords << " records salted";
+
+        return ss.str();
+
+    }
+
+    // Account bytes taken, returns bytes in memory
+    uint64_t memoryMetrics_t::reserve(uint64_t bytes) {
+
+        const uint64_t now = (current += bytes);
+        uint64_t highest = peak;
+
+        while (now > highest && !peak.compare_exchange_weak(highest, now)) {}
+
+        return now;
+
+    }
+
+    // Account bytes freed
+    void memoryMetrics_t::release(uint64_t bytes) {
+
+        current -= bytes;
+
+    }
+
+    // Account a dump of bytes in memory to a run
+    void memoryMetrics_t::addSpill(uint64_t bytes) {
+
+        ++spills;
+        spilledBytes += bytes;
+
+    }
+
+    // Get string representation of the counters
+    std::string memoryMetrics_t::toString() const {
+
+        std::ostringstream ss;
+
+        ss << current << " bytes in memory, peak " << peak << " bytes, " << spills
+           << " spills of " << spilledBytes << " bytes";
+
+        return ss.str();
+
+    }
+
+    // Get string representation of the metrics
+    std::string Metrics::toString() const {
+
+        std::string ret;
+
+        if (shuffle.blocks > 0) {
+            ret += "shuffle: " + shuffle.toString();
+        }
+
+        if (spill.blocks > 0) {
+            if (!ret.empty()) {
+                ret += "; ";
+            }
+            ret += "spill: " + spill.toString();
+        }
+
+        if (flow.deferredBlocks > 0) {
+            if (!ret.empty()) {
+                ret += "; ";
+            }
+            ret += "flow: " + flow.toString();
+        }
+
+        if (skew.reduceRecords > 0) {
+            if (!ret.empty()) {
+                ret += "; ";
+            }
+            ret += "skew: " + skew.toString();
+        }
+
+        if (memory.peak > 0) {
+            if (!ret.empty()) {
+                ret += "; ";
+            }
+            ret += "memory: " + memory.toString();
+        }
+
+        return ret;
+
+    }
+
+    // CPU time consumed by the calling thread (ns)
+    uint64_t threadCPUTime() {
+
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0) {
+            return 0;
+        }
+
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
+    }
+
+    // Monotonic wall clock time (ns)
+    uint64_t wallTime() {
+
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+            return 0;
+        }
+
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
+    }
+}
@@ -0,0 +1,305 @@
+#include <unistd.h>       // close, unlink, pread, pwrite, ftruncate
+#include <fcntl.h>        // open, O_xxx, fallocate
+#include <errno.h>        // errno, EINTR, EEXIST
+
+#include "segmentStore.hpp"
+#include "def.hpp"        // RANDOM_FILE_NAME_LENGTH, SEGMENT_GROW_SIZE, E, I
+#include "utils.hpp"      // randomString
+
+namespace ch {
+
+    // Create the store file if it does not exist
+    bool SegmentStore::create() {
+
+        if (_fd != -1) {
+            return true;
+        }
+
+        std::string path;
+
+        do {
+            path = _dir + "/." + randomString(RANDOM_FILE_NAME_LENGTH);
+            _fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        } while (_fd == -1 && errno == EEXIST);
+
+        if (_fd == -1) {
+            E("(SegmentStore) Fail to create store file.");
+            return false;
+        }
+
+        // The name is not needed, space is freed when the file is closed
+        unlink(path.c_str());
+
+        return true;
+
+    }
+
+    // Find length bytes of space, from removed runs first
+    bool SegmentStore::reserve(uint64_t length, uint64_t & offset) {
+
+        for (size_t i = 0; i < _free.size(); ++i) {
+            if (_free[i].length >= length) {
+                offset = _free[i].offset;
+                _free[i].offset += length;
+                _free[i].length -= length;
+                if (_free[i].length == 0) {
+                    _free.erase(_free.begin() + i);
+                }
+                return true;
+            }
+        }
+
+        if (!create()) {
+            return false;
+        }
+
+        if (_tail + length > _allocated) {
+            const uint64_t grow = MAX_VAL(static_cast<uint64_t>(SEGMENT_GROW_SIZE),
+                                          _tail + length - _allocated);
+#if defined (__gnu_linux__)
+            int ret = fallocate(_fd, 0, _allocated, grow);
+            if (ret != 0) {
+                ret = ftruncate(_fd, _allocated + grow);
+            }
+#else
+            int ret = ftruncate(_fd, _allocated + grow);
+#endif
+            if (ret != 0) {
+                E("(SegmentStore) Fail to extend store file.");
+                I("Check if there is no space.");
+                return false;
+            }
+            _allocated += grow;
+        }
+
+        offset = _tail;
+        _tail += length;
+
+        return true;
+
+    }
+
+    // Give space back, coalesced with its neighbours
+    void SegmentStore::release(const extent_t & extent) {
+
+        // Space stays allocated in the file, the next runs are written over it
+        size_t i = 0;
+        while (i < _free.size() && _free[i].offset < extent.offset) {
+            ++i;
+        }
+
+        _free.insert(_free.begin() + i, extent);
+
+        // Merge with next, then with previous
+        if (i + 1 < _free.size() && _free[i].offset + _free[i].length == _free[i + 1].offset) {
+            _free[i].length += _free[i + 1].length;
+            _free.erase(_free.begin() + i + 1);
+        }
+        if (i > 0 && _free[i - 1].offset + _free[i - 1].length == _free[i].offset) {
+            _free[i - 1].length += _free[i].length;
+            _free.erase(_free.begin() + i);
+        }
+
+    }
+
+    // Constructor: store file in dir, ioThreads reading runs ahead (one per reader
+    // expected to read at the same time)
+    SegmentStore::SegmentStore(const std::string & dir, size_t ioThreads)
+    : _dir{dir}, _fd{-1}, _tail{0}, _allocated{0}, _nextRun{0},
+      _ioThreads{MAX_VAL(ioThreads, 1)} {}
+
+    // Destructor
+    SegmentStore::~SegmentStore() {
+
+        if (_ioPool != nullptr) {
+            _ioPool->stop();
+        }
+
+        if (_fd != -1) {
+            close(_fd);
+        }
+
+    }
+
+    // Create an empty run, returns its id
+    size_t SegmentStore::createRun() {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        _catalogue[_nextRun];
+
+        return _nextRun++;
+
+    }
+
+    // Append bytes to a run
+    bool SegmentStore::append(size_t run, const char * data, size_t length) {
+
+        uint64_t offset;
+
+        {
+            std::lock_guard<std::mutex> holder{_lock};
+
+            auto it = _catalogue.find(run);
+
+            if (it == _catalogue.end() || !reserve(length, offset)) {
+                return false;
+            }
+
+            std::vector<extent_t> & extents = it->second;
+
+            if (!extents.empty() && extents.back().offset + extents.back().length == offset) {
+                extents.back().length += length;
+            } else {
+                extents.push_back(extent_t{offset, length});
+            }
+        }
+
+        // Space is owned by the run, write without the lock
+        while (length != 0) {
+            ssize_t written = pwrite(_fd, data, length, offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                E("(SegmentStore) Fail to write store file.");
+                I("Check if there is no space.");
+                return false;
+            }
+            data += written;
+            offset += written;
+            length -= written;
+        }
+
+        return true;
+
+    }
+
+    // Read up to length bytes at offset of a run, returns bytes read (0 at the end,
+    // SEGMENT_READ_ERROR if the run is unknown or reading fails)
+    size_t SegmentStore::read(size_t run, uint64_t offset, char * data, size_t length) {
+
+        uint64_t position = 0;
+        size_t available = 0;
+
+        {
+            std::lock_guard<std::mutex> holder{_lock};
+
+            auto it = _catalogue.find(run);
+
+            if (it == _catalogue.end()) {
+                E("(SegmentStore) Read of an unknown run.");
+                return SEGMENT_READ_ERROR;
+            }
+
+            // Find the extent holding offset
+            for (const extent_t & extent: it->second) {
+                if (offset < extent.length) {
+                    position = extent.offset + offset;
+                    available = extent.length - offset;
+                    break;
+                }
+                offset -= extent.length;
+            }
+        }
+
+        length = MIN_VAL(length, available);
+
+        size_t got = 0;
+
+        while (got < length) {
+            ssize_t n = pread(_fd, data + got, length - got, position + got);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                E("(SegmentStore) Fail to read store file.");
+                return SEGMENT_READ_ERROR;
+            }
+            got += n;
+        }
+
+        return got;
+
+    }
+
+    // Read as read does on an I/O thread, data must stay valid till the result is got
+    std::future<size_t> SegmentStore::readAhead(size_t run, uint64_t offset, char * data,
+                                                size_t length) {
+
+        {
+            std::lock_guard<std::mutex> holder{_lock};
+
+            if (_ioPool == nullptr) {
+                _ioPool.reset(new ThreadPool{_ioThreads});
+            }
+        }
+
+        return _ioPool->addTask([this, run, offset, data, length](){
+            return read(run, offset, data, length);
+        });
+
+    }
+
+    // Remove a run, its space is reused
+    void SegmentStore::removeRun(size_t run) {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        auto it = _catalogue.find(run);
+
+        if (it == _catalogue.end()) {
+            return;
+        }
+
+        for (const extent_t & extent: it->second) {
+            release(extent);
+        }
+
+        _catalogue.erase(it);
+
+        // No run left, all space is free from the beginning
+        if (_catalogue.empty()) {
+            _free.clear();
+            _tail = 0;
+        }
+
+    }
+
+    // Bytes of a run
+    uint64_t SegmentStore::runSize(size_t run) {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        uint64_t ret = 0;
+
+        auto it = _catalogue.find(run);
+
+        if (it != _catalogue.end()) {
+            for (const extent_t & extent: it->second) {
+                ret += extent.length;
+            }
+        }
+
+        return ret;
+
+    }
+
+    // Number of runs in the catalogue
+    size_t SegmentStore::runs() {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        return _catalogue.size();
+
+    }
+
+    // Bytes of the store file in use
+    uint64_t SegmentStore::size() {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        return _tail;
+
+    }
+}
@@ -0,0 +1,750 @@
+#include <unistd.h>       // close, pipe, read, write
+#include <fcntl.h>        // fcntl, O_NONBLOCK
+#include <poll.h>         // poll
+#include <errno.h>        // errno, EINTR, EAGAIN
+#include <string.h>       // memcpy
+#include <sys/socket.h>   // socketpair, accept, send, recv, shutdown, setsockopt
+#include <netinet/in.h>   // IPPROTO_TCP
+#include <netinet/tcp.h>  // TCP_NODELAY
+
+#include <chrono>         // seconds, steady_clock
+#include <set>            // set
+
+#include "shuffleMesh.hpp"
+#include "utils.hpp"      // sconnect, prepareServer, psend
+
+// Do not raise SIGPIPE when peer closed the connection
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace ch {
+
+    // Set file descriptor non-blocking
+    static bool setNonBlocking(int fd) {
+
+        int flags = fcntl(fd, F_GETFL, 0);
+
+        return (flags >= 0) && (fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0);
+
+    }
+
+    // Send small frames (e.g. credits) without delay
+    static void setNoDelay(int fd) {
+
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(int));
+
+    }
+
+    // Wake up the event loop
+    void ShuffleMesh::wake() {
+
+        const char c = 0;
+
+        // Ignore failure: the pipe is full so the loop wakes up anyway
+        if (write(_wakefd[1], &c, sizeof(char)) < 0) {
+            D("(ShuffleMesh) Wake up pipe is full.");
+        }
+
+    }
+
+    // Event loop: forward bytes between channels and peers
+    void ShuffleMesh::eventLoop() {
+
+        std::vector<struct pollfd> fds;
+        std::vector<std::shared_ptr<peer_t> > polledPeers;
+        std::vector<std::pair<channelKey_t, std::shared_ptr<channel_t> > > polledChannels;
+        std::set<std::string> backedUp;
+        bool waiting = false;
+
+        while (_running) {
+
+            fds.clear();
+            polledPeers.clear();
+            polledChannels.clear();
+            backedUp.clear();
+
+            {
+                std::lock_guard<std::mutex> holder{_lock};
+
+                waiting = expireChannels();
+
+                fds.push_back({_wakefd[0], POLLIN, 0});
+                fds.push_back({_serverfd, POLLIN, 0});
+
+                // Stop reading from a machine while a channel holds too much of its bytes,
+                // till the job reads them or the channel is reset
+                for (const auto & entry: _channels) {
+                    const channel_t & channel = *(entry.second);
+
+                    if (channel.toLocal.size() - channel.written >= MESH_MAX_BUFFERED) {
+                        backedUp.insert(entry.first.first);
+                    }
+                }
+
+                for (const std::shared_ptr<peer_t> & peer: _peers) {
+                    short events = 0;
+                    if (backedUp.find(peer->ip) == backedUp.end()) {
+                        events |= POLLIN;
+                    }
+                    if (peer->sent < peer->out.size()) {
+                        events |= POLLOUT;
+                    }
+                    fds.push_back({peer->fd, events, 0});
+                    polledPeers.push_back(peer);
+                }
+
+                for (const auto & entry: _channels) {
+                    const channel_t & channel = *(entry.second);
+
+                    if (channel.fd == INVALID_SOCKET) {
+                        continue;
+                    }
+
+                    short events = 0;
+
+                    // Stop reading from jobs while the connection is backed up
+                    auto route = _routes.find(entry.first.first);
+                    if (route == _routes.end() ||
+                        route->second->out.size() - route->second->sent < MESH_MAX_PENDING) {
+                        events |= POLLIN;
+                    }
+                    if (channel.written < channel.toLocal.size()) {
+                        events |= POLLOUT;
+                    }
+
+                    fds.push_back({channel.fd, events, 0});
+                    polledChannels.push_back(entry);
+                }
+            }
+
+            // Channels waiting to be opened are checked every second
+            if (poll(fds.data(), fds.size(), waiting ? 1000 : -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                E("(ShuffleMesh) Poll failed.");
+                break;
+            }
+
+            std::lock_guard<std::mutex> holder{_lock};
+
+            if (fds[0].revents != 0) {
+                char buffer[BUFFER_SIZE];
+                while (read(_wakefd[0], buffer, BUFFER_SIZE) > 0) {}
+            }
+
+            if (fds[1].revents & POLLIN) {
+                int sockfd;
+                while ((sockfd = accept(_serverfd, nullptr, nullptr)) >= 0) {
+                    setNonBlocking(sockfd);
+                    setNoDelay(sockfd);
+                    _peers.push_back(std::make_shared<peer_t>(sockfd));
+                }
+            }
+
+            size_t i = 2;
+
+            for (const std::shared_ptr<peer_t> & peer: polledPeers) {
+                short revents = fds[i++].revents;
+
+                if (peer->fd == INVALID_SOCKET) { // dropped in this round
+                    continue;
+                }
+
+                bool alive = true;
+                if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                    alive = readPeer(peer);
+                }
+                if (alive && (revents & POLLOUT)) {
+                    alive = writePeer(*peer);
+                }
+                if (!alive) {
+                    dropPeer(peer);
+                }
+            }
+
+            for (const auto & entry: polledChannels) {
+                short revents = fds[i++].revents;
+                channel_t & channel = *(entry.second);
+
+                if (channel.fd == INVALID_SOCKET) {
+                    continue;
+                }
+
+                if (revents & POLLOUT) {
+                    writeChannel(channel);
+                }
+                if ((revents & (POLLIN | POLLHUP | POLLERR)) && !readChannel(entry.first, channel)) {
+                    // Closed by the job
+                    close(channel.fd);
+                    channel.fd = INVALID_SOCKET;
+                    if (!channel.remoteClosed) {
+                        _closed.insert(entry.first);
+                    }
+                    _channels.erase(entry.first);
+                }
+            }
+
+            // Send frames produced in this round
+            std::vector<std::shared_ptr<peer_t> > peers{_peers};
+            for (const std::shared_ptr<peer_t> & peer: peers) {
+                if (peer->sent < peer->out.size() && !writePeer(*peer)) {
+                    dropPeer(peer);
+                }
+            }
+
+            // Job sees end of channel once everything from peer is written
+            for (const auto & entry: _channels) {
+                channel_t & channel = *(entry.second);
+
+                if (channel.remoteClosed && !channel.shut && channel.fd != INVALID_SOCKET &&
+                    channel.written == channel.toLocal.size()) {
+                    shutdown(channel.fd, SHUT_WR);
+                    channel.shut = true;
+                }
+            }
+        }
+
+    }
+
+    // Append a frame to the send buffer of a peer
+    void ShuffleMesh::appendFrame(peer_t & peer, uint32_t kind, const std::string & key,
+                                  const char * payload, size_t length) {
+
+        meshHeader_t header;
+        header.kind = kind;
+        header.keyLength = key.size();
+        header.length = length;
+
+        peer.out.append(reinterpret_cast<const char *>(&header), sizeof(meshHeader_t));
+        peer.out.append(key);
+        if (length > 0) {
+            peer.out.append(payload, length);
+        }
+
+    }
+
+    // Get channel receiving from a peer, nullptr if it is closed locally
+    ShuffleMesh::channel_t * ShuffleMesh::getChannel(const channelKey_t & key) {
+
+        auto it = _channels.find(key);
+
+        if (it != _channels.end()) {
+            return it->second.get();
+        }
+
+        if (_closed.find(key) != _closed.end() || _expired.find(key) != _expired.end()) {
+            return nullptr;
+        }
+
+        // Peer sends before the job here opens the channel
+        std::shared_ptr<channel_t> & channel = _channels[key];
+        channel = std::make_shared<channel_t>();
+        return channel.get();
+
+    }
+
+    // Parse frames received from a peer, false if a frame is corrupted
+    bool ShuffleMesh::parseFrames(const std::shared_ptr<peer_t> & peer) {
+
+        const char * data = peer->in.data();
+        size_t pos = 0;
+        const size_t l = peer->in.size();
+        meshHeader_t header;
+
+        while (l - pos >= sizeof(meshHeader_t)) {
+            memcpy(&header, data + pos, sizeof(meshHeader_t));
+
+            if (header.keyLength > MESH_MAX_KEY_LENGTH || header.length > MESH_FRAME_SIZE) {
+                E("(ShuffleMesh) Corrupted frame.");
+                return false;
+            }
+
+            const size_t frameLength = sizeof(meshHeader_t) + header.keyLength + header.length;
+            if (l - pos < frameLength) {
+                break;
+            }
+
+            const char * key = data + pos + sizeof(meshHeader_t);
+            const char * payload = key + header.keyLength;
+
+            if (header.kind == MESH_HELLO) {
+                peer->ip.assign(key, header.keyLength);
+                if (_routes.find(peer->ip) == _routes.end()) {
+                    _routes[peer->ip] = peer;
+                }
+                PSS("(ShuffleMesh) Peer " << peer->ip << " connected.");
+            } else if (!peer->ip.empty()) {
+                channelKey_t channelKey{peer->ip, std::string{key, header.keyLength}};
+
+                if (header.kind == MESH_DATA) {
+                    channel_t * channel = getChannel(channelKey);
+                    if (channel != nullptr) { // else closed locally, drop
+                        channel->toLocal.append(payload, header.length);
+                        writeChannel(*channel);
+                    }
+                } else if (header.kind == MESH_CLOSE) {
+                    channel_t * channel = getChannel(channelKey);
+                    if (channel != nullptr) {
+                        channel->remoteClosed = true;
+                    } else {
+                        // Both ends closed
+                        _closed.erase(channelKey);
+                    }
+                } else if (header.kind == MESH_RESET) {
+                    // Nothing reads the channel on the peer, the job writing to it fails
+                    auto it = _channels.find(channelKey);
+                    if (it != _channels.end()) {
+                        ESS("(ShuffleMesh) Channel " << channelKey.second << " is reset by "
+                            << peer->ip);
+                        if (it->second->fd != INVALID_SOCKET) {
+                            close(it->second->fd);
+                            it->second->fd = INVALID_SOCKET;
+                        }
+                        _channels.erase(it);
+                    }
+                }
+            }
+
+            pos += frameLength;
+        }
+
+        peer->in.erase(0, pos);
+
+        return true;
+
+    }
+
+    // Read from a peer, false if the connection is lost
+    bool ShuffleMesh::readPeer(const std::shared_ptr<peer_t> & peer) {
+
+        char buffer[MESH_FRAME_SIZE];
+
+        while (true) {
+            ssize_t n = ::recv(peer->fd, buffer, MESH_FRAME_SIZE, 0);
+
+            if (n > 0) {
+                peer->in.append(buffer, n);
+                if (n < MESH_FRAME_SIZE || peer->in.size() >= MESH_MAX_BUFFERED) {
+                    break;
+                }
+            } else if (n == 0) {
+                return false;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno != EINTR) {
+                return false;
+            }
+        }
+
+        return parseFrames(peer);
+
+    }
+
+    // Write pending frames to a peer, false if the connection is lost
+    bool ShuffleMesh::writePeer(peer_t & peer) {
+
+        while (peer.sent < peer.out.size()) {
+            ssize_t n = ::send(peer.fd, peer.out.data() + peer.sent, peer.out.size() - peer.sent,
+                               MSG_NOSIGNAL);
+
+            if (n > 0) {
+                peer.sent += n;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else if (n < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+
+        if (peer.sent == peer.out.size()) {
+            peer.out.clear();
+            peer.sent = 0;
+        } else if (peer.sent > peer.out.size() / 2) {
+            peer.out.erase(0, peer.sent);
+            peer.sent = 0;
+        }
+
+        return true;
+
+    }
+
+    // Forward bytes written by the job to the peer, false if channel is closed by the job
+    bool ShuffleMesh::readChannel(const channelKey_t & key, channel_t & channel) {
+
+        char buffer[MESH_FRAME_SIZE];
+        auto route = _routes.find(key.first);
+
+        while (true) {
+            ssize_t n = ::recv(channel.fd, buffer, MESH_FRAME_SIZE, 0);
+
+            if (n > 0) {
+                if (route == _routes.end()) { // connection lost, drop
+                    continue;
+                }
+                appendFrame(*(route->second), MESH_DATA, key.second, buffer, n);
+                if (n < MESH_FRAME_SIZE ||
+                    route->second->out.size() - route->second->sent >= MESH_MAX_PENDING) {
+                    return true;
+                }
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            } else if (n == 0 || errno != EINTR) {
+                if (route != _routes.end()) {
+                    appendFrame(*(route->second), MESH_CLOSE, key.second, nullptr, 0);
+                }
+                return false;
+            }
+        }
+
+    }
+
+    // Write bytes from peer to the channel
+    void ShuffleMesh::writeChannel(channel_t & channel) {
+
+        if (channel.fd == INVALID_SOCKET) {
+            return;
+        }
+
+        while (channel.written < channel.toLocal.size()) {
+            ssize_t n = ::send(channel.fd, channel.toLocal.data() + channel.written,
+                               channel.toLocal.size() - channel.written, MSG_NOSIGNAL);
+
+            if (n > 0) {
+                channel.written += n;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else { // full, or closed by the job (found by readChannel)
+                break;
+            }
+        }
+
+        if (channel.written == channel.toLocal.size()) {
+            channel.toLocal.clear();
+            channel.written = 0;
+        } else if (channel.written > channel.toLocal.size() / 2) {
+            channel.toLocal.erase(0, channel.written);
+            channel.written = 0;
+        }
+
+    }
+
+    // Drop a lost connection, channels of its IP are closed
+    void ShuffleMesh::dropPeer(const std::shared_ptr<peer_t> & peer) {
+
+        close(peer->fd);
+        peer->fd = INVALID_SOCKET;
+
+        for (auto it = _peers.begin(); it != _peers.end(); ++it) {
+            if (*it == peer) {
+                _peers.erase(it);
+                break;
+            }
+        }
+
+        if (peer->ip.empty()) {
+            return;
+        }
+
+        ESS("(ShuffleMesh) Lost connection to " << peer->ip);
+
+        auto route = _routes.find(peer->ip);
+        if (route == _routes.end() || route->second != peer) {
+            return;
+        }
+        _routes.erase(route);
+
+        // Another connection to the same machine takes over
+        for (const std::shared_ptr<peer_t> & other: _peers) {
+            if (other->ip == peer->ip) {
+                _routes[peer->ip] = other;
+                return;
+            }
+        }
+
+        for (auto & entry: _channels) {
+            if (entry.first.first == peer->ip) {
+                entry.second->remoteClosed = true;
+            }
+        }
+
+    }
+
+    // Reset channels peers send to that no job opened in MESH_OPEN_TIMEOUT seconds,
+    // true if some channel still waits to be opened
+    bool ShuffleMesh::expireChannels() {
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        bool waiting = false;
+
+        for (auto it = _channels.begin(); it != _channels.end();) {
+            const channel_t & channel = *(it->second);
+
+            if (channel.fd != INVALID_SOCKET) {
+                ++it;
+                continue;
+            }
+
+            if (now - channel.created < std::chrono::seconds(MESH_OPEN_TIMEOUT)) {
+                waiting = true;
+                ++it;
+                continue;
+            }
+
+            // Bytes held are dropped, the sender is told to fail instead of sending more
+            ESS("(ShuffleMesh) Channel " << it->first.second << " from " << it->first.first
+                << " is not opened, reset.");
+
+            auto route = _routes.find(it->first.first);
+            if (route != _routes.end()) {
+                appendFrame(*(route->second), MESH_RESET, it->first.second, nullptr, 0);
+            }
+
+            _expired.insert(it->first);
+            it = _channels.erase(it);
+        }
+
+        return waiting;
+
+    }
+
+    // Get connection to an IP, connect if there is none
+    std::shared_ptr<ShuffleMesh::peer_t> ShuffleMesh::getRoute(const std::string & ip) {
+
+        {
+            std::lock_guard<std::mutex> holder{_lock};
+
+            auto route = _routes.find(ip);
+            if (route != _routes.end()) {
+                return route->second;
+            }
+        }
+
+        int sockfd = INVALID_SOCKET;
+        int tries = 0;
+
+        while (!sconnect(sockfd, ip.c_str(), _port)) {
+            if (sockfd != INVALID_SOCKET) {
+                close(sockfd);
+                sockfd = INVALID_SOCKET;
+            }
+            if (++tries == MAX_CONNECTION_ATTEMPT) {
+                ESS("(ShuffleMesh) Fail to connect to " << ip);
+                return nullptr;
+            }
+            // wait at least CONNECTION_RETRY_INTERVAL second before another try
+            std::this_thread::sleep_for(std::chrono::seconds(CONNECTION_RETRY_INTERVAL));
+        }
+
+        std::shared_ptr<peer_t> peer = std::make_shared<peer_t>(sockfd);
+        peer->ip = ip;
+
+        // Hello goes first, tells the peer which IP to route to
+        peer_t hello{sockfd};
+        appendFrame(hello, MESH_HELLO, _selfIP, nullptr, 0);
+        if (!psend(sockfd, hello.out.data(), hello.out.size())) {
+            ESS("(ShuffleMesh) Fail to connect to " << ip);
+            close(sockfd);
+            return nullptr;
+        }
+
+        setNonBlocking(sockfd);
+        setNoDelay(sockfd);
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        _peers.push_back(peer);
+
+        // Peer may have connected meanwhile
+        std::shared_ptr<peer_t> & route = _routes[ip];
+        if (!route) {
+            route = peer;
+        }
+
+        wake();
+
+        PSS("(ShuffleMesh) Connected to " << ip);
+
+        return route;
+
+    }
+
+    // Default constructor
+    ShuffleMesh::ShuffleMesh()
+    : _serverfd{INVALID_SOCKET}, _port{STREAMMANAGER_PORT}, _wakefd{INVALID_SOCKET, INVALID_SOCKET},
+      _loop{nullptr}, _running{false} {}
+
+    // Destructor
+    ShuffleMesh::~ShuffleMesh() {
+
+        stop();
+
+    }
+
+    // Accept peers at port and start the event loop
+    bool ShuffleMesh::start(unsigned short port) {
+
+        if (_loop != nullptr) {
+            return true;
+        }
+
+        if (!prepareServer(_serverfd, port, true)) {
+            if (_serverfd >= 0) {
+                close(_serverfd);
+            }
+            _serverfd = INVALID_SOCKET;
+            return false;
+        }
+
+        if (pipe(_wakefd) < 0) {
+            close(_serverfd);
+            _serverfd = INVALID_SOCKET;
+            return false;
+        }
+
+        setNonBlocking(_serverfd);
+        setNonBlocking(_wakefd[0]);
+        setNonBlocking(_wakefd[1]);
+
+        _port = port;
+        _running = true;
+        _loop = new std::thread{&ShuffleMesh::eventLoop, this};
+
+        return true;
+
+    }
+
+    // Stop the event loop and close all connections
+    void ShuffleMesh::stop() {
+
+        if (_loop == nullptr) {
+            return;
+        }
+
+        _running = false;
+        wake();
+        _loop->join();
+        delete _loop;
+        _loop = nullptr;
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        for (const std::shared_ptr<peer_t> & peer: _peers) {
+            close(peer->fd);
+        }
+        _peers.clear();
+        _routes.clear();
+
+        for (const auto & entry: _channels) {
+            if (entry.second->fd != INVALID_SOCKET) {
+                close(entry.second->fd);
+            }
+        }
+        _channels.clear();
+        _closed.clear();
+        _expired.clear();
+
+        close(_serverfd);
+        close(_wakefd[0]);
+        close(_wakefd[1]);
+        _serverfd = _wakefd[0] = _wakefd[1] = INVALID_SOCKET;
+
+    }
+
+    // Open channel with key to peer at peerIP, fd is the local end
+    // the channel is closed by closing fd
+    bool ShuffleMesh::openChannel(const std::string & selfIP, const std::string & peerIP,
+                                  const std::string & key, int & fd) {
+
+        if (_loop == nullptr) {
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> holder{_connectLock};
+
+            if (_selfIP.empty()) {
+                _selfIP = selfIP;
+            }
+
+            if (!getRoute(peerIP)) {
+                return false;
+            }
+        }
+
+        int sv[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+            E("(ShuffleMesh) Fail to create channel.");
+            return false;
+        }
+
+        setNonBlocking(sv[0]);
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        channelKey_t channelKey{peerIP, key};
+
+        if (_expired.find(channelKey) != _expired.end()) {
+            ESS("(ShuffleMesh) Channel " << key << " was reset, not opened in time.");
+            close(sv[0]);
+            close(sv[1]);
+            return false;
+        }
+
+        std::shared_ptr<channel_t> & channel = _channels[channelKey];
+
+        if (!channel) {
+            channel = std::make_shared<channel_t>();
+        } else if (channel->fd != INVALID_SOCKET) {
+            ESS("(ShuffleMesh) Channel " << key << " is already open.");
+            close(sv[0]);
+            close(sv[1]);
+            return false;
+        }
+
+        channel->fd = sv[0];
+        _closed.erase(channelKey);
+        fd = sv[1];
+
+        // Flush bytes arrived before opening
+        wake();
+
+        return true;
+
+    }
+
+    // Forget channels of a finished job (keys start with jobName)
+    void ShuffleMesh::endJob(const std::string & jobName) {
+
+        std::lock_guard<std::mutex> holder{_lock};
+
+        for (auto it = _channels.begin(); it != _channels.end();) {
+            if (it->second->fd == INVALID_SOCKET &&
+                it->first.second.compare(0, jobName.size(), jobName) == 0) {
+                it = _channels.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto it = _closed.begin(); it != _closed.end();) {
+            if (it->second.compare(0, jobName.size(), jobName) == 0) {
+                it = _closed.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto it = _expired.begin(); it != _expired.end();) {
+            if (it->second.compare(0, jobName.size(), jobName) == 0) {
+                it = _expired.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+    }
+}
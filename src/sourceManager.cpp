@@ -45,6 +45,7 @@ namespace ch {
     // Connect to workers and deliver files
     bool SourceManagerMaster::connectAndDeliver(const ipconfig_t & ips,
                                                 const std::string & jobName,
+                                                const std::string & outputFilePath,
                                                 unsigned short port) {
 
         size_t l = ips.size();
@@ -91,7 +92,7 @@ namespace ch {
                 int & sockfd = connections[i];
 
                 // Start connection threads
-                threadPool.addTask([i, &ips, &sockfd, &jobName, this](){
+                threadPool.addTask([i, &ips, &sockfd, &jobName, &outputFilePath, this](){
 
                     // create client on clients
                     if(!invokeWorker(sockfd)) {
@@ -123,6 +124,13 @@ namespace ch {
                         return;
                     }
 
+                    // Send output path (workers may write part files under it)
+                    if (!sendString(sockfd, outputFilePath)) {
+                        close(sockfd);
+                        sockfd = INVALID_SOCKET;
+                        return;
+                    }
+
                 });
             }
 
@@ -148,11 +156,35 @@ namespace ch {
 
     }
 
+    // Receive result (and output manifest on success) of the ith worker
+    void SourceManagerMaster::receiveResult(const int sockfd, const size_t i) {
+
+        char receivedChar;
+
+        if (!precv(sockfd, static_cast<void *>(&receivedChar), sizeof(char))) {
+            E("(SourceManagerMaster) No response from worker.");
+            return;
+        }
+
+        if (receivedChar != RES_SUCCESS) {
+            return;
+        }
+
+        if (!receiveString(sockfd, workerManifests[i])) {
+            E("(SourceManagerMaster) Cannot receive output manifest from worker.");
+            return;
+        }
+
+        workerIsSuccess[i] = true;
+
+    }
+
     // Start distribution thread
     void SourceManagerMaster::startDistributionThread() {
 
         size_t l = connections.size();
         workerIsSuccess.resize(l, false);
+        workerManifests.resize(l);
 
         // Start the distribution thread
         dthread = new std::thread{[this, l](){
@@ -181,13 +213,7 @@ namespace ch {
                     }
                 }
 
-                if (!precv(sockfd, static_cast<void *>(&receivedChar), sizeof(char))) {
-                    E("(SourceManagerMaster) No response from worker.");
-                    close(sockfd);
-                    return;
-                }
-
-                this->workerIsSuccess[1] = (receivedChar == RES_SUCCESS);
+                this->receiveResult(sockfd, 1);
                 close(sockfd);
             } else if (l <= THREAD_POOL_SIZE) {
                 // Less than/equals to THREAD_POOL_SIZE threads, start threads directly
@@ -217,13 +243,7 @@ namespace ch {
                             }
                         }
 
-                        if (!precv(sockfd, static_cast<void *>(&receivedChar), sizeof(char))) {
-                            E("(SourceManagerMaster) No response from worker.");
-                            close(sockfd);
-                            return;
-                        }
-
-                        this->workerIsSuccess[i] = (receivedChar == RES_SUCCESS);
+                        this->receiveResult(sockfd, i);
                         close(sockfd);
                     });
                 }
@@ -342,22 +362,9 @@ namespace ch {
 #endif
                             // It is guaranteed that only one thread for a sockfd runs at the same time
                             if (repliedEOF[sockfd]) {
-                                char receivedChar = RES_FAIL;
-
-                                if (!precv(sockfd, static_cast<void *>(&receivedChar), sizeof(char))) {
-                                    E("(SourceManagerMaster) No response from worker.");
-                                    ++endedConnection;
-                                    close(sockfd);
-                                } else {
-                                    if (receivedChar == RES_FAIL) {
-                                        ++endedConnection;
-                                        close(sockfd);
-                                    } else if (receivedChar == RES_SUCCESS) {
-                                        this->workerIsSuccess[fdToIndex[sockfd]] = (receivedChar == RES_SUCCESS);
-                                        ++endedConnection;
-                                        close(sockfd);
-                                    }
-                                }
+                                this->receiveResult(sockfd, fdToIndex[sockfd]);
+                                ++endedConnection;
+                                close(sockfd);
                             } else {
                                 // provide poll service
                                 char receivedChar;
@@ -436,6 +443,15 @@ namespace ch {
 
     }
 
+    // Append output manifests of workers in order of their index
+    void SourceManagerMaster::appendWorkerManifests(std::string & manifest) const {
+
+        for (size_t i = 1, l = workerManifests.size(); i < l; ++i) {
+            manifest += workerManifests[i];
+        }
+
+    }
+
     inline bool SourceManagerMaster::isValid() const {
 
         return splitter.isValid();
@@ -490,10 +506,12 @@ namespace ch {
     // Receive resource files
     // 1. Configuration file
     // 2. Job file
+    // 3. Output path
     bool SourceManagerWorker::receiveFiles(std::string & confFilePath,
                                            std::string & jobFilePath,
                                            std::string & jobName,
-                                           std::string & workingDir) {
+                                           std::string & workingDir,
+                                           std::string & outputFilePath) {
 
         if (!isValid()) {
             D("(SourceManagerWorker) The socket failed.");
@@ -522,6 +540,11 @@ namespace ch {
             return false;
         }
 
+        if (!receiveString(fd, outputFilePath)) {
+            E("Fail to receive output path.");
+            return false;
+        }
+
         return true;
 
     }
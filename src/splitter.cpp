@@ -2,7 +2,7 @@
 
 namespace ch {
     // Default constructor
-    Splitter::Splitter(): _fd{nullptr}, bufferedLength{0} {
+    Splitter::Splitter(): _fd{nullptr}, bufferedLength{0}, _records{false} {
 
         buffer[DATA_BLOCK_SIZE] = '\0';
 
@@ -15,10 +15,71 @@ namespace ch {
 
     }
 
-    // Open the file
+    // Get next split of a record file: whole blocks of DATA_BLOCK_SIZE bytes at least,
+    // unless the file ends (magics of concatenated record files are skipped)
+    bool Splitter::nextBlocks(std::string & res) {
+
+        const size_t magicLength = LENGTH_CONST_CHAR_ARRAY(RECORD_FILE_MAGIC);
+        blockHeader_t header;
+        char * h = reinterpret_cast<char *>(&header);
+
+        while (res.size() < DATA_BLOCK_SIZE) {
+            // A header is longer than a magic, which is told apart by its first bytes
+            const size_t got = fread(h, sizeof(char), magicLength, _fd);
+
+            if (got == 0) { // EOF
+                setFd(nullptr);
+                return !res.empty();
+            }
+
+            if (got == magicLength && memcmp(h, RECORD_FILE_MAGIC, magicLength) == 0) {
+                continue;
+            }
+
+            const size_t rest = sizeof(blockHeader_t) - magicLength;
+
+            if (got != magicLength || fread(h + got, sizeof(char), rest, _fd) != rest ||
+                header.storedLength > MAX_RECORD_BLOCK_SIZE) {
+                E("(Splitter) Corrupted record file. File is not consumed completely.");
+                setFd(nullptr);
+                return false;
+            }
+
+            const size_t offset = res.size();
+
+            res.append(h, sizeof(blockHeader_t));
+            res.resize(offset + sizeof(blockHeader_t) + header.storedLength);
+
+            if (header.storedLength != 0 &&
+                fread(&res[offset + sizeof(blockHeader_t)], sizeof(char),
+                      header.storedLength, _fd) != header.storedLength) {
+                E("(Splitter) Truncated record file. File is not consumed completely.");
+                setFd(nullptr);
+                return false;
+            }
+        }
+
+        return true;
+
+    }
+
+    // Open the file, a record file is detected by its magic
     bool Splitter::open(const char * file) {
 
         setFd(fopen(file, "r"));
+
+        if (isValid()) {
+            const size_t magicLength = LENGTH_CONST_CHAR_ARRAY(RECORD_FILE_MAGIC);
+            char magic[magicLength];
+
+            _records = (fread(magic, sizeof(char), magicLength, _fd) == magicLength &&
+                        memcmp(magic, RECORD_FILE_MAGIC, magicLength) == 0);
+
+            if (!_records) {
+                rewind(_fd);
+            }
+        }
+
         return isValid();
 
     }
@@ -40,6 +101,7 @@ namespace ch {
 
         _fd = fd;
         bufferedLength = 0;
+        _records = false;
 
     }
 
@@ -53,7 +115,11 @@ namespace ch {
             return false;
         }
 
-        size_t rv = pfread(_fd, buffer + bufferedLength, DATA_BLOCK_SIZE - bufferedLength);
+        if (_records) {
+            return nextBlocks(res);
+        }
+
+        size_t rv = fread(buffer + bufferedLength, sizeof(char), DATA_BLOCK_SIZE - bufferedLength, _fd);
 
         if (rv == 0) { // EOF
             if (bufferedLength == 0) {
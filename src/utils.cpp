@@ -1,5 +1,10 @@
 #include "utils.hpp"
 
+// Do not raise SIGPIPE when peer closed the connection
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 namespace ch {
 
     /*
@@ -15,7 +20,7 @@ namespace ch {
 
         while (len != 0 &&
                   (
-                      (sent = send(fd, cbuf + offset, len, 0)) > 0 ||
+                      (sent = send(fd, cbuf + offset, len, MSG_NOSIGNAL)) > 0 ||
                       (sent == -1 && errno == EINTR)
                   )
               ) {
@@ -166,7 +171,7 @@ namespace ch {
     }
 
     // Prepare to accept connection
-    bool prepareServer(int & serverfd, const unsigned short port){
+    bool prepareServer(int & serverfd, const unsigned short port, bool reuseAddress){
 
         sockaddr_in addr;
 
@@ -177,6 +182,11 @@ namespace ch {
             return false;
         }
 
+        if (reuseAddress) {
+            int on = 1;
+            setsockopt(serverfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(int));
+        }
+
         memset(&addr, 0, sizeof(sockaddr_in));
         addr.sin_family = AF_INET;
         addr.sin_port = htons(port);
@@ -371,7 +381,11 @@ namespace ch {
 
         const ssize_t strSize = str.size();
 
-        if (psend(sockfd, static_cast<const void *>(&strSize), sizeof(ssize_t)) && strSize > 0) {
+        if (psend(sockfd, static_cast<const void *>(&strSize), sizeof(ssize_t))) {
+            if (strSize == 0) {
+                return true;
+            }
+
             const char * strStart = str.data();
             ssize_t sentSize = 0;
             ssize_t byteLeft, toSend;
@@ -401,7 +415,11 @@ namespace ch {
         char buffer[BUFFER_SIZE];
         ssize_t strSize;
 
-        if (precv(sockfd, static_cast<void *>(&strSize), sizeof(ssize_t)) && strSize > 0) {
+        if (precv(sockfd, static_cast<void *>(&strSize), sizeof(ssize_t)) && strSize >= 0) {
+            if (strSize == 0) {
+                return true;
+            }
+
             str.reserve(strSize);
             ssize_t receivedSize = 0;
             ssize_t byteLeft, toReceive;
@@ -680,4 +698,38 @@ namespace ch {
         return ret;
 
     }
+
+    // Index of the calling thread, threads are numbered in order of first call
+    size_t threadIndex() {
+
+        static std::atomic<size_t> next{0};
+        thread_local size_t index = next++;
+
+        return index;
+
+    }
+
+    // Append decimal digits of v to buf, nothing is allocated if buf has room
+    void appendDecimal(std::string & buf, long long v) {
+
+        char digits[24];
+        char * end = digits + sizeof(digits);
+        char * cur = end;
+
+        // Negate as unsigned, so the smallest value does not overflow
+        unsigned long long u = (v < 0) ? 0ULL - static_cast<unsigned long long>(v)
+                                       : static_cast<unsigned long long>(v);
+
+        do {
+            *(--cur) = static_cast<char>('0' + u % 10);
+            u /= 10;
+        } while (u != 0);
+
+        if (v < 0) {
+            *(--cur) = '-';
+        }
+
+        buf.append(cur, end - cur);
+
+    }
 }
@@ -0,0 +1,31 @@
+#include "compressor.hpp"
+#include <cstdio>
+#include <string>
+
+using namespace std;
+using namespace ch;
+
+bool roundTrip(const string & raw, uint32_t codec) {
+    string block;
+    string decoded;
+    encodeBlock(raw, 1, codec, block);
+    blockHeader_t header = *reinterpret_cast<const blockHeader_t *>(block.data());
+    printf("%u -> %u bytes\n", header.rawLength, header.storedLength);
+    return decodeBlock(header, block.data() + sizeof(blockHeader_t), decoded) && decoded == raw;
+}
+
+int main() {
+    string text;
+    for (int i = 0; i < 5000; i++) {
+        text += "hello world " + to_string(i % 97) + " ";
+    }
+    string noise;
+    for (int i = 0; i < 5000; i++) {
+        noise.push_back(static_cast<char>((i * 7919) ^ (i >> 3)));
+    }
+    bool ok = roundTrip(text, CODEC_LZ) && roundTrip(noise, CODEC_LZ) &&
+              roundTrip("", CODEC_LZ) && roundTrip("abc", CODEC_LZ) &&
+              roundTrip(string(100000, 'a'), CODEC_LZ) && roundTrip(text, CODEC_NONE);
+    puts(ok ? "Passed." : "Failed.");
+    return ok ? 0 : 1;
+}
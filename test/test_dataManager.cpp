@@ -0,0 +1,54 @@
+#include "dataManager.hpp"
+#include "metrics.hpp"
+#include "type.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+using namespace ch;
+
+// Store random integers over a memory budget, spilled in background or not, and read them back
+bool checkSpill(bool async) {
+    const size_t budget = 8 << 20;
+    const size_t n = 2000000;
+    options_t options;
+    options.memoryBudget = budget;
+    options.asyncSpill = async;
+    options.storeShards = 1;
+    Metrics metrics;
+    DataManager<Integer> * data = new DataManager<Integer>{"/tmp", options, &metrics};
+    for (size_t i = 0; i < n; ++i) {
+        if (!data->store(Integer{rand()})) {
+            delete data;
+            return false;
+        }
+    }
+    // Spills alternate with the data filling up, each dumps its whole share of the budget
+    const uint64_t spills = metrics.memory.spills;
+    const uint64_t share = async ? budget / 2 : budget;
+    if (spills == 0 || metrics.memory.spilledBytes / spills < share * 3 / 4 ||
+        metrics.memory.peak > budget + 1024) {
+        printf("%s\n", metrics.memory.toString().c_str());
+        delete data;
+        return false;
+    }
+    SortedStream<Integer> * stm = data->getSortedStream();
+    bool ok = (stm != nullptr);
+    Integer v;
+    int last = -1;
+    size_t i = 0;
+    for (; ok && stm->get(v); ++i) {
+        ok = (v.value >= last);
+        last = v.value;
+    }
+    delete stm;
+    delete data;
+    return ok && (i == n) && (metrics.memory.current == 0);
+}
+
+int main() {
+    srand(7);
+    bool ok = checkSpill(true) && checkSpill(false);
+    puts(ok ? "Passed." : "Failed.");
+    return ok ? 0 : 1;
+}
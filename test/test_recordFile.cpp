@@ -0,0 +1,80 @@
+#include "recordFile.hpp"
+#include "splitter.hpp"
+#include "type.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+
+using namespace std;
+using namespace ch;
+
+typedef Tuple<String, Integer> Record;
+
+// Write records to a record file in codec
+bool writeFile(const char * path, const vector<Record> & records, uint32_t codec) {
+    RecordFileWriter<Record> os{codec};
+    if (!os.open(path)) {
+        return false;
+    }
+    for (const Record & r: records) {
+        if (!os.write(r)) {
+            return false;
+        }
+    }
+    return os.close() && os.records() == records.size();
+}
+
+// Read records of a file split by Splitter and compare with expected
+bool checkSplits(const char * path, const vector<Record> & expected) {
+    Splitter splitter;
+    if (!splitter.open(path)) {
+        return false;
+    }
+    string split;
+    Record r;
+    size_t i = 0;
+    while (splitter.next(split)) {
+        SplitReader<Record> is{split};
+        while (is.read(r)) {
+            if (i >= expected.size() || r.first != expected[i].first ||
+                r.second != expected[i].second) {
+                printf("Mismatch at %zu\n", i);
+                return false;
+            }
+            ++i;
+        }
+    }
+    return i == expected.size();
+}
+
+int main() {
+    srand(7);
+    vector<Record> records;
+    for (size_t i = 0; i < 50000; ++i) {
+        records.emplace_back(String{"key" + to_string(rand() % 1000)}, Integer{rand()});
+    }
+    const char * a = "/tmp/test_recordFile_a";
+    const char * b = "/tmp/test_recordFile_b";
+    const char * ab = "/tmp/test_recordFile_ab";
+    vector<Record> half(records.begin(), records.begin() + 100);
+    bool ok = writeFile(a, records, CODEC_LZ) && writeFile(b, half, CODEC_NONE) &&
+              checkSplits(a, records) && checkSplits(b, half);
+
+    // Concatenated record files are read as one
+    {
+        ofstream os(ab, ios::binary);
+        ifstream ia(a, ios::binary), ib(b, ios::binary);
+        os << ia.rdbuf() << ib.rdbuf();
+    }
+    vector<Record> both{records};
+    both.insert(both.end(), half.begin(), half.end());
+    ok = ok && checkSplits(ab, both);
+
+    remove(a);
+    remove(b);
+    remove(ab);
+    puts(ok ? "Passed." : "Failed.");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+#include "sortedStream.hpp"
+#include "groupIterator.hpp"
+#include "hashAggregator.hpp"
+#include "type.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace ch;
+
+namespace ch {
+    // Counts of keys are added up when aggregated by hash
+    template <>
+    struct recordCombine_t<Tuple<Integer, Integer> >
+        : public sumValues_t<Tuple<Integer, Integer> > {};
+}
+
+// Merge runs of the given sizes (sorted random integers) and compare with sort
+bool checkMerge(const vector<size_t> & sizes) {
+    SortedStream<Integer> stm;
+    vector<Integer> expected;
+    for (size_t n: sizes) {
+        vector<Integer> run;
+        for (size_t i = 0; i < n; ++i) {
+            run.emplace_back(rand() % 1000);
+        }
+        sort(run.begin(), run.end());
+        expected.insert(expected.end(), run.begin(), run.end());
+        vector<const Integer *> data;
+        for (const Integer & v: run) {
+            data.push_back(new Integer{v});
+        }
+        stm.addRun(new MemoryRunReader<Integer>(data, nullptr, 0));
+    }
+    sort(expected.begin(), expected.end());
+    Integer v;
+    size_t i = 0;
+    for (; stm.peek() != nullptr; ++i) {
+        const Integer next = *(stm.peek());
+        if (!stm.get(v) || i >= expected.size() || v != expected[i] || v != next) {
+            printf("Mismatch at %zu\n", i);
+            return false;
+        }
+    }
+    return (i == expected.size()) && !stm.isValid() && !stm.get(v);
+}
+
+// Sum values of each key of runs of (key, 1) with GroupIterator
+bool checkGroups() {
+    SortedStream<Tuple<Integer, Integer> > stm;
+    vector<int> counts(50, 0);
+    for (size_t r = 0; r < 4; ++r) {
+        vector<Tuple<Integer, Integer> > run;
+        for (size_t i = 0; i < 500; ++i) {
+            run.emplace_back(Integer{rand() % 50}, Integer{1});
+            ++counts[run.back().first.value];
+        }
+        sort(run.begin(), run.end());
+        vector<const Tuple<Integer, Integer> *> data;
+        for (const Tuple<Integer, Integer> & v: run) {
+            data.push_back(new Tuple<Integer, Integer>{v});
+        }
+        stm.addRun(new MemoryRunReader<Tuple<Integer, Integer> >(data, nullptr, 0));
+    }
+    GroupIterator<Tuple<Integer, Integer> > groups{stm};
+    Tuple<Integer, Integer> res;
+    int last = -1;
+    while (groups.nextKey(res)) {
+        for (const Tuple<Integer, Integer> & e: groups.values()) {
+            res += e;
+        }
+        if (res.first.value <= last || res.second.value != counts[res.first.value]) {
+            printf("Wrong group %d\n", res.first.value);
+            return false;
+        }
+        last = res.first.value;
+    }
+    return true;
+}
+
+// Count keys of (key, 1) with HashAggregator, spilled (and split again) if budget is small
+bool checkAggregate(size_t budget) {
+    options_t options;
+    options.memoryBudget = budget;
+    memoryMetrics_t memory;
+    vector<int> counts(3000, 0);
+    HashAggregator<Tuple<Integer, Integer> > * aggregator =
+        new HashAggregator<Tuple<Integer, Integer> >("/tmp", options, &memory);
+    for (size_t i = 0; i < 100000; ++i) {
+        const int key = rand() % 3000;
+        ++counts[key];
+        if (!aggregator->add(Tuple<Integer, Integer>{Integer{key}, Integer{1}})) {
+            delete aggregator;
+            return false;
+        }
+    }
+    SortedStream<Tuple<Integer, Integer> > stm;
+    stm.addRun(aggregator);
+    Tuple<Integer, Integer> res;
+    while (stm.get(res)) {
+        if (counts[res.first.value] != res.second.value) {
+            printf("Wrong count of %d\n", res.first.value);
+            return false;
+        }
+        counts[res.first.value] = 0;
+    }
+    // No record is added once reading started
+    if (aggregator->add(Tuple<Integer, Integer>{Integer{0}, Integer{1}})) {
+        printf("Added after reading\n");
+        return false;
+    }
+    // Spilled partitions are split again rather than loaded over the budget
+    if (budget != 0 && memory.peak > budget + 1024) {
+        printf("Peak %zu over budget %zu\n", static_cast<size_t>(memory.peak), budget);
+        return false;
+    }
+    return (count(counts.begin(), counts.end(), 0) == 3000) && (memory.current == 0);
+}
+
+int main() {
+    srand(7);
+    bool ok = checkMerge({}) && checkMerge({0}) && checkMerge({5}) &&
+              checkMerge({3, 0, 7}) && checkMerge({100, 1, 0, 50, 2000, 3});
+    vector<size_t> many;
+    for (size_t i = 0; i < 37; ++i) {
+        many.push_back(rand() % 300);
+    }
+    ok = ok && checkMerge(many) && checkGroups() &&
+         checkAggregate(0) && checkAggregate(32 << 10) && checkAggregate(4 << 10);
+    puts(ok ? "Passed." : "Failed.");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include "sorter.hpp"
+#include "recordArena.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace ch;
+
+namespace ch {
+    // Secondary sort: values of a key in order
+    template <>
+    struct recordOrder_t<Tuple<Integer, Integer> >
+        : public secondarySort_t<Tuple<Integer, Integer> > {};
+}
+
+template <typename DataType>
+bool checkSort(const vector<DataType> & records, size_t threads) {
+    vector<const DataType *> data;
+    for (const DataType & v: records) {
+        data.push_back(&v);
+    }
+    sortRecords(data, threads);
+    vector<DataType> expected{records};
+    sort(expected.begin(), expected.end());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (*(data[i]) != expected[i]) {
+            printf("Mismatch at %zu\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sort (key, value) pairs by key, then value, in memory and in an arena
+bool checkSecondary(size_t threads) {
+    vector<Tuple<Integer, Integer> > records;
+    RecordArena<Tuple<Integer, Integer> > arena;
+    for (int i = 0; i < 150000; ++i) {
+        records.emplace_back(Integer{rand() % 100}, Integer{rand()});
+        arena.add(records.back());
+    }
+    vector<const Tuple<Integer, Integer> *> data;
+    for (const Tuple<Integer, Integer> & v: records) {
+        data.push_back(&v);
+    }
+    sortRecords(data, threads);
+    arena.sort();
+    Tuple<Integer, Integer> v;
+    for (size_t i = 1; i < data.size(); ++i) {
+        if (secondarySort_t<Tuple<Integer, Integer> >::less(*(data[i]), *(data[i - 1])) ||
+            !arena.get(i, v) || v.first != data[i]->first || v.second != data[i]->second) {
+            printf("Secondary order broken at %zu\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Long keys: duplicates, a long shared prefix, and keys differing after the nesting limit
+bool checkLongKeys() {
+    vector<String> strs;
+    const string prefix(5000, 'p');
+    for (int i = 0; i < 200; ++i) {
+        strs.emplace_back(string(5000, 'x'));
+        strs.emplace_back(prefix + to_string(rand() % 50));
+        string s(100, 'a');
+        for (char & c: s) {
+            c = static_cast<char>('a' + rand() % 2);
+        }
+        strs.emplace_back(s);
+    }
+    vector<String> same(200, String{string(5000, 'y')});
+    return checkSort(strs, 1) && checkSort(same, 1);
+}
+
+int main() {
+    srand(7);
+    vector<Integer> ints;
+    vector<String> strs;
+    vector<Tuple<String, Integer> > tuples;
+    for (int i = 0; i < 200000; ++i) {
+        ints.emplace_back(rand() - RAND_MAX / 2);
+        string s(rand() % 12, 'a');
+        for (char & c: s) {
+            c = static_cast<char>(rand() % 4 ? 'a' + rand() % 3 : rand() % 256);
+        }
+        strs.emplace_back(s);
+        tuples.emplace_back(String{s}, Integer{i});
+    }
+    vector<Integer> small(ints.begin(), ints.begin() + 50);
+    bool ok = checkSort(ints, 1) && checkSort(strs, 1) && checkSort(tuples, 1) &&
+              checkSort(small, 1);
+    random_shuffle(ints.begin(), ints.end());
+    random_shuffle(strs.begin(), strs.end());
+    ok = ok && checkSort(ints, 3) && checkSort(strs, 4) && checkSecondary(1) && checkSecondary(2) &&
+         checkLongKeys();
+    puts(ok ? "Passed." : "Failed.");
+    return ok ? 0 : 1;
+}
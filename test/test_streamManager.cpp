@@ -7,11 +7,14 @@ int main(int argc, char ** argv) {
     ipconfig_t ips;
     ips.push_back(pair<size_t, string>(0, "127.0.0.1"));
     string s(".");
-    StreamManager<Tuple<String, Integer> > sm(ips, s, 100);
+    options_t options;
+    options.maxDataSize = 100;
+    StreamManager<Tuple<String, Integer> > sm(ips, s, "test", options);
     String str("Hello from server.");
     Integer i(89);
     Tuple<String, Integer> tp(str, i);
-    sm.push(tp, zeroPartitioner);
+    sm.setPartitioner(zeroPartitioner);
+    sm.push(tp);
     sm.finalizeSend();
     sm.blockTillRecvEnd();
     return 0;
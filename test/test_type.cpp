@@ -4,6 +4,17 @@
 using namespace std;
 using namespace ch;
 
+// Format a tuple in a style and compare with expected text
+bool checkFormat(const Tuple<String, Integer> & t, uint32_t style, const string & expected) {
+    string buf;
+    t.format(buf, style);
+    if (buf != expected) {
+        cout << "Format " << style << ": " << buf << endl;
+        return false;
+    }
+    return true;
+}
+
 Integer get() {
     return Integer(2);
 }
@@ -19,5 +30,11 @@ int main() {
     Integer c(get1(k));
     cout << j.toString();
     cout << k.toString();
-    cout << c.toString();
+    cout << c.toString() << endl;
+    Tuple<String, Integer> t{String{"a,\"b\"\tc"}, Integer{-2147483647 - 1}};
+    bool ok = checkFormat(t, TEXT_REPR, t.toString()) &&
+              checkFormat(t, TEXT_CSV, "\"a,\"\"b\"\"\tc\",-2147483648") &&
+              checkFormat(t, TEXT_TSV, "a,\"b\"\\tc\t-2147483648");
+    cout << (ok ? "Passed." : "Failed.") << endl;
+    return ok ? 0 : 1;
 }